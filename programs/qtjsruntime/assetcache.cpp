@@ -0,0 +1,79 @@
+#include "assetcache.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+
+namespace {
+
+// together the cached files use at most this much memory
+const qint64 maxTotalSize = 64 << 20;
+// larger files are read as usual
+const qint64 maxFileSize = 8 << 20;
+
+}
+
+AssetCache::AssetCache() :totalSize(0), hits(0), misses(0), diskHits(0),
+        diskMisses(0) {
+}
+AssetCache&
+AssetCache::instance() {
+    static AssetCache cache;
+    return cache;
+}
+bool
+AssetCache::get(const QString& path, QByteArray& data) {
+    const QFileInfo info(path);
+    if (!info.isFile() || info.size() > maxFileSize) {
+        return false;
+    }
+    QHash<QString, Entry>::const_iterator i = entries.constFind(path);
+    if (i != entries.constEnd() && i.value().size == info.size()
+            && i.value().modified == info.lastModified()
+            && contents.contains(i.value().hash)) {
+        data = contents.value(i.value().hash);
+        hits += 1;
+        return true;
+    }
+    misses += 1;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    data = file.readAll();
+    Entry entry;
+    entry.size = info.size();
+    entry.modified = info.lastModified();
+    entry.hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+    entries[path] = entry;
+    if (!contents.contains(entry.hash)) {
+        contents.insert(entry.hash, data);
+        order.enqueue(entry.hash);
+        totalSize += data.size();
+    }
+    // entries that point at evicted contents count as misses
+    while (totalSize > maxTotalSize && order.size() > 1) {
+        totalSize -= contents.take(order.dequeue()).size();
+    }
+    return true;
+}
+void
+AssetCache::countDiskCache(bool hit) {
+    if (hit) {
+        diskHits += 1;
+    } else {
+        diskMisses += 1;
+    }
+}
+QVariantMap
+AssetCache::statistics() const {
+    QVariantMap s;
+    s["hits"] = hits;
+    s["misses"] = misses;
+    s["hitRatio"] = hits + misses ? double(hits) / (hits + misses) : 0.0;
+    s["size"] = totalSize;
+    s["diskHits"] = diskHits;
+    s["diskMisses"] = diskMisses;
+    s["diskHitRatio"] = diskHits + diskMisses
+            ? double(diskHits) / (diskHits + diskMisses) : 0.0;
+    return s;
+}
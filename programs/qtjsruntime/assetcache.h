@@ -0,0 +1,47 @@
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QQueue>
+#include <QString>
+#include <QVariantMap>
+
+// keeps local files that pages load, such as scripts, style sheets and
+// the html shell, in memory for all pages of the process; entries are
+// checked against the size and modification time of the file, and files
+// with equal contents are stored once
+class AssetCache {
+private:
+    struct Entry {
+        qint64 size;
+        QDateTime modified;
+        QByteArray hash;
+    };
+    QHash<QString, Entry> entries;
+    QHash<QByteArray, QByteArray> contents;
+    // hashes in the order they were added, for eviction
+    QQueue<QByteArray> order;
+    qint64 totalSize;
+    int hits;
+    int misses;
+    int diskHits;
+    int diskMisses;
+    AssetCache();
+public:
+    static AssetCache& instance();
+    /**
+     * Set data to the contents of the local file at path, from memory if
+     * the file has not changed. Returns false if the file cannot be read or
+     * is too large to be cached.
+     */
+    bool get(const QString& path, QByteArray& data);
+    /**
+     * Count a network reply that was or was not served from the disk cache.
+     */
+    void countDiskCache(bool hit);
+    QVariantMap statistics() const;
+};
+
+#endif
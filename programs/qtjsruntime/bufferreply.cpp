@@ -0,0 +1,13 @@
+#include "bufferreply.h"
+#include <cstring>
+
+BufferReply::BufferReply(QObject* parent, const QNetworkRequest& request,
+                         const QByteArray& data_, const QString& contentType)
+        :MemoryReply(parent, request), data(data_) {
+    succeed(data.size(), contentType);
+}
+qint64
+BufferReply::produce(char* out, qint64 offset, qint64 maxSize) {
+    memcpy(out, data.constData() + offset, maxSize);
+    return maxSize;
+}
@@ -0,0 +1,18 @@
+#ifndef BUFFERREPLY_H
+#define BUFFERREPLY_H
+
+#include "memoryreply.h"
+
+// a network reply with contents that are already in memory
+class BufferReply : public MemoryReply {
+Q_OBJECT
+private:
+    const QByteArray data;
+protected:
+    qint64 produce(char* out, qint64 offset, qint64 maxSize);
+public:
+    BufferReply(QObject* parent, const QNetworkRequest& request,
+                const QByteArray& data, const QString& contentType);
+};
+
+#endif
@@ -0,0 +1,550 @@
+#include "daemon.h"
+#include "assetcache.h"
+#include "memoryusage.h"
+#include "outputcache.h"
+#include "pagerunner.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QWebSettings>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * Turn a tab separated manifest row into a job. The columns are input,
+ * output and optionally format, followed by options as key=value.
+ */
+QVariantMap
+parseRow(const QByteArray& line, QString& error) {
+    QStringList columns = QString::fromUtf8(line).trimmed().split('\t');
+    QVariantMap job;
+    if (columns.length() < 2) {
+        error = "A row needs an input and an output.";
+        return job;
+    }
+    job["input"] = columns[0];
+    job["output"] = columns[1];
+    if (columns.length() > 2 && !columns[2].isEmpty()) {
+        job["format"] = columns[2];
+    }
+    for (int i = 3; i < columns.length(); ++i) {
+        int eq = columns[i].indexOf('=');
+        if (eq == -1) {
+            error = "Option '" + columns[i] + "' is not key=value.";
+            return QVariantMap();
+        }
+        job[columns[i].left(eq)] = columns[i].mid(eq + 1);
+    }
+    return job;
+}
+/**
+ * Return the output format of a job, which defaults to the suffix of the
+ * output.
+ */
+QString
+jobFormat(const QVariantMap& job) {
+    const QString format = job.value("format").toString();
+    if (format.isEmpty()) {
+        return QFileInfo(job.value("output").toString()).suffix().toLower();
+    }
+    return format;
+}
+
+}
+
+QByteArray
+LineReader::readStdinLine() {
+    int end = buffer.indexOf('\n');
+    while (end == -1) {
+        pollfd fd = { 0, POLLIN, 0 };
+        const int ready = poll(&fd, 1, 100);
+        if (stopping.load()) {
+            return QByteArray();
+        }
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        char chunk[4096];
+        const ssize_t n = read(0, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        buffer.append(chunk, n);
+        end = buffer.indexOf('\n', buffer.size() - n);
+    }
+    // at the end of the input, the rest is returned like QIODevice::readLine
+    // would
+    const QByteArray line = (end == -1) ? buffer : buffer.left(end + 1);
+    buffer.remove(0, line.size());
+    return line;
+}
+void
+LineReader::run() {
+    QFile in(path);
+    if (!path.isEmpty()) {
+        in.open(QIODevice::ReadOnly);
+    }
+    capacity.acquire();
+    while (!stopping.load()) {
+        const QByteArray line = path.isEmpty() ? readStdinLine()
+                : in.readLine();
+        if (line.isEmpty()) {
+            break;
+        }
+        emit lineRead(line);
+        capacity.acquire();
+    }
+}
+
+Daemon::Daemon(const QStringList& args_) :args(args_),
+        settings(PageRunner::parseArguments(args_)), cache(0), server(0),
+        reader(0),
+        maxQueue(qMax(1, settings.value("queue-size", "64").toInt())),
+        recycleAfter(settings.value("recycle-after").toInt()),
+        inputClosed(false), batch(settings.contains("batch")), failCount(0),
+        rowCount(0), jobCount(0), recycleCount(0), maxQueued(0) {
+    out.open(stdout, QIODevice::WriteOnly);
+    uptime.start();
+    const QString manifest = settings.value("batch");
+    if (batch && !QFileInfo(manifest).isReadable()) {
+        QTextStream err(stderr);
+        err << "Cannot read manifest '" << manifest << "'.\n";
+        QMetaObject::invokeMethod(this, "exitWithError", Qt::QueuedConnection);
+        return;
+    }
+    QStringList arguments;
+    PageRunner::parseArguments(args, &arguments);
+    page = arguments.value(0);
+    if (settings.contains("cache-dir")) {
+        cache = new OutputCache(settings.value("cache-dir"),
+                settings.value("cache-size", "1024").toLongLong() << 20);
+    }
+    // dead resources are dropped as soon as possible and the caches are
+    // cleared after every job, see PageRunner::complete
+    QWebSettings::setObjectCacheCapacities(0, 4 << 20, 16 << 20);
+    QWebSettings::setMaximumPagesInCache(0);
+    const int n = qMax(1, settings.value("workers", "1").toInt());
+    for (int i = 0; i < n; ++i) {
+        workers.append(startWorker());
+    }
+    const QString name = settings.value("daemon");
+    if (batch || name == "-") {
+        reader = new LineReader(maxQueue, manifest);
+        connect(reader, SIGNAL(lineRead(QByteArray)),
+                this, SLOT(readStdin(QByteArray)));
+        connect(reader, SIGNAL(finished()), this, SLOT(stdinClosed()));
+        reader->start();
+        return;
+    }
+    server = new QLocalServer(this);
+    connect(server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+    // a socket left behind by a crashed daemon would block listen()
+    QLocalServer::removeServer(name);
+    if (!server->listen(name)) {
+        QTextStream err(stderr);
+        err << "Cannot listen on '" << name << "': " << server->errorString()
+            << "\n";
+        // the event loop is not running yet, so exit once it is
+        QMetaObject::invokeMethod(this, "exitWithError", Qt::QueuedConnection);
+    }
+}
+Daemon::~Daemon() {
+    if (reader) {
+        // the reader may still wait for input if the daemon exits early
+        reader->stop();
+        reader->wait();
+        delete reader;
+    }
+    foreach (Worker* w, workers) {
+        delete w->page;
+        delete w;
+    }
+    delete cache;
+}
+Daemon::Worker*
+Daemon::startWorker() {
+    Worker* w = new Worker();
+    w->page = new PageRunner(args);
+    w->ready = false;
+    w->busy = false;
+    w->jobCount = 0;
+    w->busyTime = 0;
+    connect(w->page, SIGNAL(runFinished(int, QVariantMap)),
+            this, SLOT(runFinished(int, QVariantMap)));
+    return w;
+}
+Daemon::Worker*
+Daemon::worker(QObject* page) {
+    foreach (Worker* w, workers) {
+        if (w->page == page) {
+            return w;
+        }
+    }
+    return 0;
+}
+void
+Daemon::readStdin(const QByteArray& line) {
+    addJob(line, &out);
+}
+void
+Daemon::stdinClosed() {
+    inputClosed = true;
+    finishIfIdle();
+}
+void
+Daemon::newConnection() {
+    QLocalSocket* socket = server->nextPendingConnection();
+    while (socket) {
+        // stop reading from the socket when its buffer is full, so that a
+        // client that sends faster than the jobs are done blocks
+        socket->setReadBufferSize(65536);
+        clients.append(socket);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        socket = server->nextPendingConnection();
+    }
+}
+void
+Daemon::readClient() {
+    readClients();
+}
+void
+Daemon::readClients() {
+    QList<QPointer<QLocalSocket> >::iterator i = clients.begin();
+    while (i != clients.end()) {
+        QLocalSocket* socket = *i;
+        if (!socket) {
+            i = clients.erase(i);
+            continue;
+        }
+        while (jobs.size() < maxQueue && socket->canReadLine()) {
+            addJob(socket->readLine(), socket);
+        }
+        ++i;
+    }
+}
+void
+Daemon::addJob(const QByteArray& line, QIODevice* client) {
+    const QByteArray trimmed = line.trimmed();
+    QVariantMap job;
+    QString error;
+    if (trimmed.startsWith('{')) {
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(trimmed, &parseError);
+        if (doc.isObject()) {
+            job = doc.object().toVariantMap();
+            if (job.isEmpty()) {
+                error = "Empty job.";
+            }
+        } else {
+            error = parseError.errorString();
+        }
+    } else if (!trimmed.isEmpty() && !trimmed.startsWith('#')) {
+        job = parseRow(trimmed, error);
+    }
+    if (job.isEmpty() || job.contains("command")) {
+        // no job is queued, so the line can be handed back to the reader
+        if (reader && client == &out) {
+            reader->release();
+        }
+        if (job.value("command") == "status") {
+            QVariantMap result;
+            result["utilization"] = utilization();
+            reply(client, result);
+        } else if (!error.isEmpty() || job.contains("command")) {
+            QVariantMap result;
+            result["status"] = 1;
+            result["error"] = error.isEmpty() ? QString("Invalid job.") : error;
+            result["line"] = QString::fromUtf8(trimmed);
+            reply(client, result);
+            record(result);
+        }
+        return;
+    }
+    rowCount += 1;
+    if (!job.contains("id")) {
+        job["id"] = rowCount;
+    }
+    // the page may resolve paths against another directory
+    if (job.contains("input")) {
+        job["input"] = QDir::current().absoluteFilePath(
+                job.value("input").toString());
+    }
+    if (job.contains("output")) {
+        job["output"] = QDir::current().absoluteFilePath(
+                job.value("output").toString());
+    }
+    Job j;
+    j.job = job;
+    j.client = client;
+    j.received.start();
+    if (useEmbeddedThumbnail(j) || (cache && fetchFromCache(j))) {
+        if (reader && client == &out) {
+            reader->release();
+        }
+        return;
+    }
+    jobs.enqueue(j);
+    maxQueued = qMax(maxQueued, jobs.size());
+    dispatch();
+}
+void
+Daemon::dispatch() {
+    foreach (Worker* w, workers) {
+        if (jobs.isEmpty()) {
+            break;
+        }
+        if (!w->ready || w->busy) {
+            continue;
+        }
+        w->job = jobs.dequeue();
+        if (reader && w->job.client == &out) {
+            reader->release();
+        }
+        w->busy = true;
+        w->busyTimer.start();
+        w->page->runJob(w->job.job);
+    }
+}
+void
+Daemon::runFinished(int status, const QVariantMap& timings) {
+    Worker* w = worker(sender());
+    if (!w) {
+        return;
+    }
+    QVariantMap result;
+    result["status"] = status;
+    if (!w->ready) {
+        // the page has loaded and is ready for jobs
+        w->ready = true;
+        result["ready"] = true;
+        result["worker"] = workers.indexOf(w);
+        result["timings"] = timings;
+        reply(&out, result);
+    } else {
+        QVariantMap t(timings);
+        qint64 total = w->job.received.elapsed();
+        qint64 busy = w->busyTimer.elapsed();
+        t["queue"] = total - busy;
+        t["total"] = total;
+        if (w->job.job.contains("id")) {
+            result["id"] = w->job.job.value("id");
+        }
+        result["worker"] = workers.indexOf(w);
+        result["timings"] = t;
+        result["memory"] = w->page->memoryUsage();
+        reply(w->job.client, result);
+        if (status == 0 && !w->job.cacheKey.isEmpty()) {
+            cache->store(w->job.cacheKey, w->job.format,
+                         w->job.job.value("output").toString());
+        }
+        result["input"] = w->job.job.value("input");
+        result["output"] = w->job.job.value("output");
+        record(result);
+        w->busy = false;
+        w->busyTime += busy;
+        w->job = Job();
+        w->jobCount += 1;
+        jobCount += 1;
+        // a page that went over the memory budget is not used again
+        if ((recycleAfter > 0 && w->jobCount >= recycleAfter)
+                || w->page->exceededMemory()) {
+            // replace the page to give back what it has accumulated
+            int i = workers.indexOf(w);
+            Worker* fresh = startWorker();
+            fresh->busyTime = w->busyTime;
+            workers[i] = fresh;
+            w->page->deleteLater();
+            delete w;
+            recycleCount += 1;
+        }
+    }
+    dispatch();
+    // the queue has room again for lines that clients have sent
+    if (server) {
+        readClients();
+    }
+    finishIfIdle();
+}
+/**
+ * Reply with the cached output of the job if there is one. Otherwise
+ * remember the key, so the output can be added when the job is done.
+ */
+bool
+Daemon::fetchFromCache(Job& job) {
+    const QString output = job.job.value("output").toString();
+    const QString format = jobFormat(job.job);
+    if ((format != "pdf" && format != "png") || output.isEmpty()
+            || job.job.contains("png-page-height")) {
+        return false;
+    }
+    QVariantMap options(job.job);
+    options.remove("id");
+    options.remove("input");
+    options.remove("output");
+    options["format"] = format;
+    QStringList files;
+    files << page << job.job.value("input").toString();
+    const QByteArray key = OutputCache::key(files, format, options);
+    if (!cache->fetch(key, format, output)) {
+        job.cacheKey = key;
+        job.format = format;
+        return false;
+    }
+    finishEarly(job, "cached");
+    return true;
+}
+/**
+ * Answer a thumbnail job with the thumbnail stored in the document, if it
+ * has one that is large enough.
+ */
+bool
+Daemon::useEmbeddedThumbnail(const Job& job) {
+    if (!job.job.contains("thumbnail") || jobFormat(job.job) != "png"
+            || !PageRunner::writeEmbeddedThumbnail(
+                job.job.value("input").toString(),
+                PageRunner::parseSize(job.job.value("thumbnail").toString()),
+                job.job.value("output").toString())) {
+        return false;
+    }
+    finishEarly(job, "embedded");
+    return true;
+}
+/**
+ * Reply to a job that was done without a page. reason is set in the result.
+ */
+void
+Daemon::finishEarly(const Job& job, const char* reason) {
+    QVariantMap result;
+    result["id"] = job.job.value("id");
+    result["status"] = 0;
+    result[reason] = true;
+    QVariantMap timings;
+    timings["total"] = job.received.elapsed();
+    result["timings"] = timings;
+    reply(job.client, result);
+    result["input"] = job.job.value("input");
+    result["output"] = job.job.value("output");
+    record(result);
+    jobCount += 1;
+}
+void
+Daemon::finishIfIdle() {
+    if (!inputClosed || !jobs.isEmpty()) {
+        return;
+    }
+    foreach (Worker* w, workers) {
+        if (w->busy) {
+            return;
+        }
+    }
+    if (batch) {
+        writeSummary();
+        qApp->exit(failCount > 0);
+        return;
+    }
+    QVariantMap result;
+    result["utilization"] = utilization();
+    reply(&out, result);
+    qApp->exit(0);
+}
+void
+Daemon::record(const QVariantMap& result) {
+    if (!batch) {
+        return;
+    }
+    results.append(result);
+    if (result.value("status").toInt() != 0) {
+        failCount += 1;
+    }
+}
+void
+Daemon::writeSummary() {
+    QVariantMap summary;
+    summary["documents"] = results;
+    summary["succeeded"] = results.size() - failCount;
+    summary["failed"] = failCount;
+    summary["utilization"] = utilization();
+    const QString path = settings.value("summary");
+    if (path.isEmpty()) {
+        // stdout carries one JSON object per line, so the summary is one
+        // more line, marked by its key
+        QVariantMap record;
+        record["summary"] = summary;
+        reply(&out, record);
+        return;
+    }
+    const QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(summary))
+            .toJson();
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()
+            || !file.commit()) {
+        QTextStream err(stderr);
+        err << "Cannot write summary '" << path << "'.\n";
+        failCount += 1;
+    }
+}
+QVariantMap
+Daemon::utilization() const {
+    const qint64 elapsed = qMax(Q_INT64_C(1), uptime.elapsed());
+    QVariantList list;
+    qint64 busy = 0;
+    foreach (const Worker* w, workers) {
+        qint64 b = w->busyTime + (w->busy ? w->busyTimer.elapsed() : 0);
+        QVariantMap m;
+        m["busy"] = b;
+        m["utilization"] = double(b) / elapsed;
+        m["ready"] = w->ready;
+        m["jobs"] = w->jobCount;
+        list.append(m);
+        busy += b;
+    }
+    QVariantMap u;
+    u["uptime"] = elapsed;
+    u["jobs"] = jobCount;
+    u["recycled"] = recycleCount;
+    u["queued"] = jobs.size();
+    u["maxQueued"] = maxQueued;
+    const qint64 rss = MemoryUsage::rss();
+    if (rss >= 0) {
+        u["rss"] = rss;
+    }
+    u["assets"] = AssetCache::instance().statistics();
+    u["workers"] = list;
+    if (cache) {
+        u["cache"] = cache->statistics();
+    }
+    u["utilization"] = double(busy) / elapsed / workers.size();
+    return u;
+}
+void
+Daemon::reply(QIODevice* client, const QVariantMap& result) {
+    if (!client) {
+        // the client went away before its job was done
+        return;
+    }
+    client->write(QJsonDocument(QJsonObject::fromVariantMap(result))
+                  .toJson(QJsonDocument::Compact) + '\n');
+    if (client == &out) {
+        out.flush();
+    }
+}
+void
+Daemon::exitWithError() {
+    qApp->exit(1);
+}
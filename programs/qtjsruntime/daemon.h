@@ -0,0 +1,142 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QPointer>
+#include <QQueue>
+#include <QSemaphore>
+#include <QStringList>
+#include <QThread>
+#include <QVariantMap>
+
+class OutputCache;
+class PageRunner;
+class QLocalServer;
+class QLocalSocket;
+
+// reads stdin or a file line by line on its own thread, so waiting for
+// input never blocks the event loop
+class LineReader : public QThread {
+Q_OBJECT
+private:
+    const QString path;
+    // a line is only read when a slot is free, which stops the producer
+    // when the job queue is full
+    QSemaphore capacity;
+    QAtomicInt stopping;
+    // stdin is polled, so a reader that waits for input can still be stopped
+    QByteArray buffer;
+    QByteArray readStdinLine();
+protected:
+    void run();
+public:
+    /**
+     * Read from the file at path, or from stdin if path is empty.
+     */
+    LineReader(int n, const QString& path_ = QString())
+        :path(path_), capacity(n), stopping(0) {}
+    /**
+     * Allow one more line to be read.
+     */
+    void release() {
+        capacity.release();
+    }
+    /**
+     * Make run() return without reading further lines.
+     */
+    void stop() {
+        stopping.store(1);
+        capacity.release();
+    }
+signals:
+    void lineRead(const QByteArray& line);
+};
+
+// runs jobs that arrive as line-delimited JSON on stdin or on a local
+// socket on a pool of loaded pages
+class Daemon : public QObject {
+Q_OBJECT
+private:
+    struct Job {
+        QVariantMap job;
+        // where the result goes; null if the client has disconnected
+        QPointer<QIODevice> client;
+        QElapsedTimer received;
+        // set if the output is to be added to the cache
+        QByteArray cacheKey;
+        QString format;
+    };
+    struct Worker {
+        PageRunner* page;
+        bool ready;
+        bool busy;
+        Job job;
+        int jobCount;
+        QElapsedTimer busyTimer;
+        qint64 busyTime;
+    };
+    const QStringList args;
+    const QMap<QString, QString> settings;
+    QFile out;
+    QList<Worker*> workers;
+    QString page;
+    OutputCache* cache;
+    QLocalServer* server;
+    QList<QPointer<QLocalSocket> > clients;
+    LineReader* reader;
+    QQueue<Job> jobs;
+    const int maxQueue;
+    // pages are replaced after this many jobs, 0 means never
+    const int recycleAfter;
+    bool inputClosed;
+    // in batch mode, the results are collected for the summary
+    const bool batch;
+    QVariantList results;
+    int failCount;
+    int rowCount;
+    QElapsedTimer uptime;
+    int jobCount;
+    int recycleCount;
+    int maxQueued;
+    Worker* startWorker();
+    Worker* worker(QObject* page);
+    void addJob(const QByteArray& line, QIODevice* client);
+    void dispatch();
+    void readClients();
+    void reply(QIODevice* client, const QVariantMap& result);
+    void record(const QVariantMap& result);
+    void writeSummary();
+    void finishIfIdle();
+    bool fetchFromCache(Job& job);
+    bool useEmbeddedThumbnail(const Job& job);
+    void finishEarly(const Job& job, const char* reason);
+    QVariantMap utilization() const;
+public:
+    /**
+     * With '--daemon -' jobs are read from stdin and the daemon exits at the
+     * end of the input. With '--daemon name' a local server with that name
+     * accepts connections that each send jobs and get their results.
+     * '--workers n' sets the number of pages, '--queue-size n' the number of
+     * jobs that wait before input is no longer read and '--recycle-after n'
+     * the number of jobs after which a page is replaced by a fresh one.
+     * With '--batch manifest' the jobs are read from a file and a summary of
+     * all results is written to '--summary file' at the end, or to stdout as
+     * a last line {"summary": ...} after the lines of the job results.
+     * With '--cache-dir dir' outputs are served from and added to an
+     * OutputCache. '--max-memory MB' fails jobs during which the process
+     * grows beyond MB and replaces their page.
+     */
+    Daemon(const QStringList& args);
+    ~Daemon();
+private slots:
+    void readStdin(const QByteArray& line);
+    void stdinClosed();
+    void newConnection();
+    void readClient();
+    void runFinished(int status, const QVariantMap& timings);
+    void exitWithError();
+};
+
+#endif
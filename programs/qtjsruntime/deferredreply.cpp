@@ -0,0 +1,86 @@
+#include "deferredreply.h"
+
+DeferredReply::DeferredReply(QObject* parent, const QNetworkRequest& request)
+        :QNetworkReply(parent), inner(0) {
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::GetOperation);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+void
+DeferredReply::start(QNetworkReply* reply) {
+    inner = reply;
+    inner->setParent(this);
+    connect(inner, SIGNAL(metaDataChanged()),
+            this, SLOT(innerMetaDataChanged()));
+    connect(inner, SIGNAL(readyRead()), this, SIGNAL(readyRead()));
+    connect(inner, SIGNAL(downloadProgress(qint64, qint64)),
+            this, SIGNAL(downloadProgress(qint64, qint64)));
+    connect(inner, SIGNAL(error(QNetworkReply::NetworkError)),
+            this, SLOT(innerError(QNetworkReply::NetworkError)));
+    connect(inner, SIGNAL(finished()), this, SLOT(innerFinished()));
+}
+void
+DeferredReply::copyMetaData() {
+    static const QNetworkRequest::Attribute attributes[] = {
+        QNetworkRequest::HttpStatusCodeAttribute,
+        QNetworkRequest::HttpReasonPhraseAttribute,
+        QNetworkRequest::RedirectionTargetAttribute,
+        QNetworkRequest::ConnectionEncryptedAttribute,
+        QNetworkRequest::SourceIsFromCacheAttribute
+    };
+    foreach (const RawHeaderPair& header, inner->rawHeaderPairs()) {
+        setRawHeader(header.first, header.second);
+    }
+    for (size_t i = 0; i < sizeof(attributes) / sizeof(attributes[0]); ++i) {
+        setAttribute(attributes[i], inner->attribute(attributes[i]));
+    }
+    setUrl(inner->url());
+}
+void
+DeferredReply::innerMetaDataChanged() {
+    copyMetaData();
+    emit metaDataChanged();
+}
+void
+DeferredReply::innerError(QNetworkReply::NetworkError code) {
+    setError(code, inner->errorString());
+    emit error(code);
+}
+void
+DeferredReply::innerFinished() {
+    copyMetaData();
+    setFinished(true);
+    emit finished();
+}
+void
+DeferredReply::abort() {
+    if (isFinished()) {
+        return;
+    }
+    if (inner) {
+        // the real reply reports the cancellation through its signals
+        inner->abort();
+        return;
+    }
+    setError(OperationCanceledError, "Operation canceled");
+    setFinished(true);
+    emit error(OperationCanceledError);
+    emit finished();
+}
+qint64
+DeferredReply::bytesAvailable() const {
+    return QNetworkReply::bytesAvailable()
+            + (inner ? inner->bytesAvailable() : 0);
+}
+qint64
+DeferredReply::readData(char* data, qint64 maxSize) {
+    if (!inner) {
+        return 0;
+    }
+    const qint64 n = inner->read(data, maxSize);
+    if (n == 0 && isFinished() && inner->bytesAvailable() == 0) {
+        return -1;
+    }
+    return n;
+}
@@ -0,0 +1,38 @@
+#ifndef DEFERREDREPLY_H
+#define DEFERREDREPLY_H
+
+#include <QNetworkReply>
+
+// stands in for a request that waits in the queue of NAM; once the request
+// is started, everything the real reply gets is passed on
+class DeferredReply : public QNetworkReply {
+Q_OBJECT
+private:
+    QNetworkReply* inner;
+    void copyMetaData();
+protected:
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char*, qint64) {
+        return -1;
+    }
+public:
+    DeferredReply(QObject* parent, const QNetworkRequest& request);
+    /**
+     * Take over the real reply, which becomes a child of this one.
+     */
+    void start(QNetworkReply* reply);
+    bool isStarted() const {
+        return inner != 0;
+    }
+    void abort();
+    qint64 bytesAvailable() const;
+    bool isSequential() const {
+        return true;
+    }
+private slots:
+    void innerMetaDataChanged();
+    void innerError(QNetworkReply::NetworkError code);
+    void innerFinished();
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "filecache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+FileCache::FileCache(int maxFiles_) :maxFiles(maxFiles_) {
+}
+FileCache::~FileCache() {
+    clear();
+}
+FileCache::Entry*
+FileCache::open(const QString& path) {
+    QFileInfo info(path);
+    Entry* entry = entries.value(path);
+    if (entry) {
+        if (info.exists() && info.size() == entry->size
+                && info.lastModified() == entry->modified) {
+            lru.removeOne(path);
+            lru.prepend(path);
+            return entry;
+        }
+        // file changed on disk since it was opened
+        close(path);
+    }
+    QFile* file = new QFile(path);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        return 0;
+    }
+    entry = new Entry();
+    entry->file = file;
+    entry->size = file->size();
+    entry->modified = info.lastModified();
+    // mapping can fail, e.g. for empty files or special devices; reads then
+    // fall back to seek and read on the open handle
+    entry->map = entry->size > 0 ? file->map(0, entry->size) : 0;
+    entries.insert(path, entry);
+    lru.prepend(path);
+    while (lru.size() > maxFiles) {
+        close(lru.last());
+    }
+    return entry;
+}
+void
+FileCache::close(const QString& path) {
+    Entry* entry = entries.take(path);
+    lru.removeOne(path);
+    if (entry) {
+        if (entry->map) {
+            entry->file->unmap(entry->map);
+        }
+        delete entry->file;
+        delete entry;
+    }
+}
+bool
+FileCache::read(const QString& path, qint64 offset, qint64 length,
+                QByteArray& data) {
+    QMutexLocker locker(&mutex);
+    Entry* entry = open(path);
+    if (!entry || offset < 0) {
+        return false;
+    }
+    if (length < 0) {
+        length = qMax(entry->size - offset, qint64(0));
+    }
+    if (entry->map) {
+        if (offset >= entry->size) {
+            data = QByteArray();
+            return true;
+        }
+        length = qMin(length, entry->size - offset);
+        data = QByteArray(reinterpret_cast<const char*>(entry->map + offset),
+                          length);
+        return true;
+    }
+    QFile* file = entry->file;
+    if (!file->seek(offset)) {
+        return false;
+    }
+    data.clear();
+    int lastLength = 0;
+    do {
+        lastLength = data.length();
+        data += file->read(length - data.length());
+    } while (data.length() < length && data.length() != lastLength);
+    return true;
+}
+void
+FileCache::invalidate(const QString& path) {
+    QMutexLocker locker(&mutex);
+    close(path);
+}
+void
+FileCache::clear() {
+    QMutexLocker locker(&mutex);
+    while (!lru.isEmpty()) {
+        close(lru.first());
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+class QFile;
+
+// keeps a small LRU of open, memory-mapped files for ranged reads; it may be
+// used from several threads
+class FileCache {
+private:
+    struct Entry {
+        QFile* file;
+        uchar* map;
+        qint64 size;
+        QDateTime modified;
+    };
+    const int maxFiles;
+    QMutex mutex;
+    QHash<QString, Entry*> entries;
+    QList<QString> lru;
+    Entry* open(const QString& path);
+    void close(const QString& path);
+public:
+    FileCache(int maxFiles = 8);
+    ~FileCache();
+    /**
+     * Read length bytes at offset from the file at absolute path.
+     * Returns false if the file cannot be read. Near the end of the file,
+     * data can be shorter than length. A negative length reads up to the
+     * end of the file.
+     */
+    bool read(const QString& path, qint64 offset, qint64 length,
+              QByteArray& data);
+    /**
+     * Forget the cached handle for path, e.g. because it was written.
+     */
+    void invalidate(const QString& path);
+    void clear();
+};
+
+#endif
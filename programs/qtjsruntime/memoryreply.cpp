@@ -0,0 +1,60 @@
+#include "memoryreply.h"
+
+MemoryReply::MemoryReply(QObject* parent, const QNetworkRequest& request)
+        :QNetworkReply(parent), size(0), delivered(0) {
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::GetOperation);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+void
+MemoryReply::succeed(qint64 size_, const QString& contentType) {
+    size = size_;
+    setHeader(QNetworkRequest::ContentLengthHeader, size);
+    if (!contentType.isEmpty()) {
+        setHeader(QNetworkRequest::ContentTypeHeader, contentType);
+    }
+    setFinished(true);
+    QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+void
+MemoryReply::fail(NetworkError code, const QString& message) {
+    size = 0;
+    setError(code, message);
+    setFinished(true);
+    QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+void
+MemoryReply::deliver() {
+    // the signals are emitted from the event loop, as nobody is connected
+    // to them while the reply is created
+    if (error() != NoError) {
+        emit error(error());
+    } else {
+        emit metaDataChanged();
+        emit readyRead();
+    }
+    emit finished();
+}
+void
+MemoryReply::abort() {
+    delivered = size;
+    close();
+}
+qint64
+MemoryReply::bytesAvailable() const {
+    return size - delivered + QNetworkReply::bytesAvailable();
+}
+qint64
+MemoryReply::readData(char* data, qint64 maxSize) {
+    const qint64 n = qMin(maxSize, size - delivered);
+    if (n <= 0) {
+        return -1;
+    }
+    const qint64 produced = produce(data, delivered, n);
+    if (produced <= 0) {
+        return -1;
+    }
+    delivered += produced;
+    return produced;
+}
@@ -0,0 +1,44 @@
+#ifndef MEMORYREPLY_H
+#define MEMORYREPLY_H
+
+#include <QNetworkReply>
+
+// base of the replies that are answered without I/O: the reply is finished
+// when it is created, its signals are emitted from the event loop and its
+// contents are handed out by produce()
+class MemoryReply : public QNetworkReply {
+Q_OBJECT
+private:
+    qint64 size;
+    qint64 delivered;
+protected:
+    MemoryReply(QObject* parent, const QNetworkRequest& request);
+    /**
+     * Finish the reply with size bytes of the given type.
+     */
+    void succeed(qint64 size, const QString& contentType);
+    /**
+     * Finish the reply with an error.
+     */
+    void fail(NetworkError code, const QString& message);
+    /**
+     * Write the next at most maxSize bytes of the contents to data, which
+     * start at offset, and return how many were written or -1 on errors.
+     * maxSize does not reach past the end of the contents.
+     */
+    virtual qint64 produce(char* data, qint64 offset, qint64 maxSize) = 0;
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char*, qint64) {
+        return -1;
+    }
+public:
+    void abort();
+    qint64 bytesAvailable() const;
+    bool isSequential() const {
+        return true;
+    }
+private slots:
+    void deliver();
+};
+
+#endif
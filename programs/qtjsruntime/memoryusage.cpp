@@ -0,0 +1,33 @@
+#include "memoryusage.h"
+#include <QFile>
+
+namespace {
+
+/**
+ * Return the value of a line like 'VmRSS:   1234 kB' in bytes.
+ */
+qint64
+statusValue(const char* key) {
+    QFile file("/proc/self/status");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QByteArray prefix = QByteArray(key) + ':';
+    // the file is generated on read and is small, so readAll is fine
+    foreach (const QByteArray& line, file.readAll().split('\n')) {
+        if (line.startsWith(prefix)) {
+            bool ok;
+            const qint64 value = line.mid(prefix.size()).simplified()
+                    .split(' ').value(0).toLongLong(&ok);
+            return ok ? value * 1024 : -1;
+        }
+    }
+    return -1;
+}
+
+}
+
+qint64
+MemoryUsage::rss() {
+    return statusValue("VmRSS");
+}
@@ -0,0 +1,17 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <QtGlobal>
+
+// resident memory of the process as reported by /proc/self/status; all
+// sizes are in bytes and -1 where the system has no /proc, so callers
+// leave them out of their reports
+class MemoryUsage {
+public:
+    /**
+     * Return the current resident set size.
+     */
+    static qint64 rss();
+};
+
+#endif
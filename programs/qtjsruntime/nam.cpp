@@ -0,0 +1,224 @@
+#include "nam.h"
+#include "assetcache.h"
+#include "bufferreply.h"
+#include "deferredreply.h"
+#include "nativezip.h"
+#include "packagereply.h"
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QMimeDatabase>
+#include <QNetworkDiskCache>
+#include <QNetworkReply>
+
+namespace {
+
+// a view of a QNetworkDiskCache that is shared by all pages of the
+// process, as a NAM deletes the cache it is given
+class SharedDiskCache : public QAbstractNetworkCache {
+private:
+    QNetworkDiskCache* const cache;
+public:
+    SharedDiskCache(QObject* parent, QNetworkDiskCache* cache_)
+        :QAbstractNetworkCache(parent), cache(cache_) {
+    }
+    /**
+     * Return the cache for dir, which lives as long as the application.
+     */
+    static QNetworkDiskCache* forDirectory(const QString& dir) {
+        static QHash<QString, QNetworkDiskCache*> caches;
+        QNetworkDiskCache*& shared = caches[QDir(dir).absolutePath()];
+        if (!shared) {
+            shared = new QNetworkDiskCache(qApp);
+            shared->setCacheDirectory(dir);
+        }
+        return shared;
+    }
+    QNetworkCacheMetaData metaData(const QUrl& url) {
+        return cache->metaData(url);
+    }
+    void updateMetaData(const QNetworkCacheMetaData& metaData) {
+        cache->updateMetaData(metaData);
+    }
+    QIODevice* data(const QUrl& url) {
+        return cache->data(url);
+    }
+    bool remove(const QUrl& url) {
+        return cache->remove(url);
+    }
+    qint64 cacheSize() const {
+        return cache->cacheSize();
+    }
+    QIODevice* prepare(const QNetworkCacheMetaData& metaData) {
+        return cache->prepare(metaData);
+    }
+    void insert(QIODevice* device) {
+        cache->insert(device);
+    }
+    void clear() {
+        cache->clear();
+    }
+};
+
+bool
+hasSuffix(const QString& path, const char* const suffixes[]) {
+    for (int i = 0; suffixes[i]; ++i) {
+        if (path.endsWith(QLatin1String(suffixes[i]))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+NAM::NAM(QObject* parent, const QString& host_, int port_)
+        :QNetworkAccessManager(parent), host(host_), port(port_),
+         nativezip(0), maxRequests(0), running(0) {
+    connect(this, SIGNAL(finished(QNetworkReply*)),
+            this, SLOT(requestFinished(QNetworkReply*)));
+}
+void
+NAM::setDiskCache(const QString& dir) {
+    // one QNetworkDiskCache per directory keeps the size limit and index
+    // right when several workers use it
+    setCache(new SharedDiskCache(this, SharedDiskCache::forDirectory(dir)));
+}
+NAM::Priority
+NAM::priority(const QNetworkRequest& request) {
+    static const char* const styles[] = {
+        ".css", ".js", ".ttf", ".otf", ".woff", ".woff2", ".eot", 0
+    };
+    static const char* const images[] = {
+        ".png", ".jpg", ".jpeg", ".gif", ".svg", ".bmp", ".webp", ".tif",
+        ".tiff", ".wmf", ".emf", 0
+    };
+    const QString path = request.url().path().toLower();
+    const QByteArray accept = request.rawHeader("Accept");
+    if (accept.startsWith("text/css") || hasSuffix(path, styles)) {
+        return Style;
+    }
+    if (accept.startsWith("image/") || hasSuffix(path, images)) {
+        return Image;
+    }
+    return Document;
+}
+bool
+NAM::isAllowed(const QUrl& url) const {
+    bool samehost = false;
+    if (port > 0) {
+        samehost = url.host() == host
+                || url.host().endsWith("." + host)
+                || host.endsWith("." + url.host());
+        samehost &= url.port() != port;
+    } else {
+        // use host string as a prefix
+        samehost = url.toString().startsWith(host);
+    }
+    return samehost;
+}
+QNetworkReply*
+NAM::createRequest(QNetworkAccessManager::Operation o,
+                   QNetworkRequest const& r, QIODevice* d) {
+    const Priority p = priority(r);
+    const bool network = r.url().scheme() == "http"
+            || r.url().scheme() == "https";
+    QByteArray data;
+    int packageId;
+    QString entry;
+    if (nativezip && r.url().scheme() == "odfpkg"
+            && o == QNetworkAccessManager::GetOperation) {
+        QNetworkReply* reply = new PackageReply(this, r,
+                NativeZip::parsePackageURL(r.url(), packageId, entry)
+                    ? nativezip->package(packageId) : 0, entry);
+        track(reply, p, false, true);
+        return reply;
+    }
+    if (!isAllowed(r.url())) {
+        // if not same host or domain and port, block
+        return QNetworkAccessManager::createRequest(o, QNetworkRequest(), d);
+    }
+    if (r.url().isLocalFile() && o == QNetworkAccessManager::GetOperation
+            && AssetCache::instance().get(r.url().toLocalFile(), data)) {
+        QNetworkReply* reply = new BufferReply(this, r, data, QMimeDatabase()
+                .mimeTypeForFile(r.url().toLocalFile(),
+                                 QMimeDatabase::MatchExtension).name());
+        track(reply, p, false, true);
+        return reply;
+    }
+    QNetworkRequest request(r);
+    // Qt also orders the requests it runs on each connection by priority
+    request.setPriority(p == Style ? QNetworkRequest::HighPriority
+            : p == Image ? QNetworkRequest::LowPriority
+            : QNetworkRequest::NormalPriority);
+    if (network && maxRequests > 0 && running >= maxRequests
+            && o == QNetworkAccessManager::GetOperation) {
+        DeferredReply* reply = new DeferredReply(this, request);
+        queue[p].append(reply);
+        track(reply, p, true, false);
+        return reply;
+    }
+    QNetworkReply* reply = QNetworkAccessManager::createRequest(o, request, d);
+    track(reply, p, network, true);
+    return reply;
+}
+void
+NAM::track(QNetworkReply* reply, Priority priority, bool network,
+           bool started) {
+    Request info;
+    info.priority = priority;
+    info.network = network;
+    info.started = started;
+    info.created = Tracer::instance() ? Tracer::instance()->now() : 0;
+    info.startTime = info.created;
+    if (network && started) {
+        running += 1;
+    }
+    requests.insert(reply, info);
+}
+void
+NAM::startQueued() {
+    for (int p = 0; p < PriorityCount; ++p) {
+        while (!queue[p].isEmpty()
+                && (maxRequests <= 0 || running < maxRequests)) {
+            DeferredReply* reply = queue[p].takeFirst();
+            Request& info = requests[reply];
+            info.started = true;
+            info.startTime = Tracer::instance() ? Tracer::instance()->now()
+                    : 0;
+            running += 1;
+            reply->start(QNetworkAccessManager::createRequest(
+                    QNetworkAccessManager::GetOperation, reply->request()));
+        }
+    }
+}
+void
+NAM::requestFinished(QNetworkReply* reply) {
+    if (!requests.contains(reply)) {
+        // a blocked request
+        return;
+    }
+    const Request info = requests.take(reply);
+    if (!info.started) {
+        // aborted while it was waiting
+        queue[info.priority].removeOne(static_cast<DeferredReply*>(reply));
+    } else if (info.network) {
+        running -= 1;
+    }
+    const bool fromCache = reply->attribute(
+            QNetworkRequest::SourceIsFromCacheAttribute).toBool();
+    if (cache() && info.network) {
+        AssetCache::instance().countDiskCache(fromCache);
+    }
+    if (Tracer::instance()) {
+        static const char* const names[] = { "style", "document", "image" };
+        QVariantMap args;
+        args["url"] = reply->url().toString();
+        args["priority"] = QString(names[info.priority]);
+        args["queued"] = info.startTime - info.created;
+        args["error"] = int(reply->error());
+        args["fromCache"] = fromCache;
+        Tracer::instance()->addSpan("request", "network", info.created, args);
+    }
+    startQueued();
+}
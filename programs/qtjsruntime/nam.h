@@ -1,48 +1,77 @@
 #ifndef NAM_H
 #define NAM_H
 
+#include <QHash>
+#include <QList>
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 
+class DeferredReply;
+class NativeZip;
+
+// network access of a page: requests to other hosts are blocked, local
+// assets and package entries are served without going through Qt, and
+// network requests are started by priority, at most maxRequests at a time
 class NAM : public QNetworkAccessManager {
 Q_OBJECT
+public:
+    // classes of requests, in the order in which they are started
+    enum Priority { Style, Document, Image, PriorityCount };
 private:
+    struct Request {
+        Priority priority;
+        bool network;
+        bool started;
+        // in trace time, if tracing is on
+        qint64 created;
+        qint64 startTime;
+    };
     const QString host;
     const int port;
-    int outstandingRequests;
+    NativeZip* nativezip;
+    // the replies that have not finished yet; blocked requests are not
+    // tracked
+    QHash<QNetworkReply*, Request> requests;
+    QList<DeferredReply*> queue[PriorityCount];
+    int maxRequests;
+    int running;
+    bool isAllowed(const QUrl& url) const;
+    void track(QNetworkReply* reply, Priority priority, bool network,
+               bool started);
+    void startQueued();
 public:
-    NAM(QObject* parent, const QString& host_ = QString(), int port_ = -1)
-            :QNetworkAccessManager(parent), host(host_), port(port_) {
-        outstandingRequests = 0;
-        connect(this, SIGNAL(finished(QNetworkReply*)),
-                this, SLOT(requestFinished()));
+    NAM(QObject* parent, const QString& host_ = QString(), int port_ = -1);
+    /**
+     * Keep responses from the network in a disk cache in dir. All NAMs of
+     * the process that use dir share one cache.
+     */
+    void setDiskCache(const QString& dir);
+    /**
+     * Serve odfpkg://pkg<id>/<entry> urls from the packages opened through
+     * nativezip. The url for an entry comes from NativeZip::entryURL.
+     */
+    void setNativeZip(NativeZip* nativezip_) {
+        nativezip = nativezip_;
     }
-    QNetworkReply* createRequest(QNetworkAccessManager::Operation o,
-            QNetworkRequest const& r, QIODevice* d) {
-        outstandingRequests += 1;
-        bool samehost = false;
-        if (port > 0) {
-            samehost = r.url().host() == host
-                    || r.url().host().endsWith("." + host)
-                    || host.endsWith("." + r.url().host());
-            samehost &= r.url().port() != port;
-        } else {
-            // use host string as a prefix
-            samehost = r.url().toString().startsWith(host);
-        }
-        if (!samehost) {
-            // if not same host or domain and port, block
-            return QNetworkAccessManager::createRequest(o, QNetworkRequest(),
-                    d);
-        }
-        return QNetworkAccessManager::createRequest(o, r, d);
+    /**
+     * Run at most n network requests at a time; the others wait, and the
+     * waiting requests with the highest priority are started first. 0 means
+     * no limit beyond that of Qt.
+     */
+    void setMaxRequests(int n) {
+        maxRequests = n;
     }
+    /**
+     * Return the priority class of a request: style sheets, scripts and
+     * fonts come first and images last.
+     */
+    static Priority priority(const QNetworkRequest& request);
+    QNetworkReply* createRequest(QNetworkAccessManager::Operation o,
+            QNetworkRequest const& r, QIODevice* d);
     bool hasOutstandingRequests() {
-        return outstandingRequests > 0;
+        return !requests.isEmpty();
     }
 public slots:
-    void requestFinished() {
-        outstandingRequests -= 1;
-    }
+    void requestFinished(QNetworkReply* reply);
 };
 #endif
@@ -1,13 +1,247 @@
 #include "nativeio.h"
+#include "tracer.h"
 #include <QWebPage>
 #include <QCoreApplication>
-#include <QTextCodec>
+#include <QCryptographicHash>
+#include <QFontDatabase>
+#include <QHash>
+#include <QRunnable>
+#include <QTemporaryFile>
+#include <QtEndian>
+#include <stdio.h>
+
+namespace {
+
+quint16
+get16(const QByteArray& data, int pos) {
+    return qFromBigEndian<quint16>(
+            reinterpret_cast<const uchar*>(data.constData()) + pos);
+}
+quint32
+get32(const QByteArray& data, int pos) {
+    return qFromBigEndian<quint32>(
+            reinterpret_cast<const uchar*>(data.constData()) + pos);
+}
+void
+put16(QByteArray& out, quint16 v) {
+    uchar b[2];
+    qToBigEndian(v, b);
+    out.append(reinterpret_cast<const char*>(b), 2);
+}
+void
+put32(QByteArray& out, quint32 v) {
+    uchar b[4];
+    qToBigEndian(v, b);
+    out.append(reinterpret_cast<const char*>(b), 4);
+}
+void
+set32(QByteArray& data, int pos, quint32 v) {
+    qToBigEndian(v, reinterpret_cast<uchar*>(data.data()) + pos);
+}
+quint32
+tableChecksum(const QByteArray& table) {
+    QByteArray padded = table;
+    padded.append(QByteArray((4 - padded.length() % 4) % 4, '\0'));
+    quint32 sum = 0;
+    for (int i = 0; i < padded.length(); i += 4) {
+        sum += get32(padded, i);
+    }
+    return sum;
+}
+
+/**
+ * Return a copy of the TrueType or OpenType font with family as its family,
+ * full and PostScript name, or an empty array if the font cannot be parsed.
+ * The tables are laid out anew with the new name table in place of the old
+ * one, and the table checksums and head.checkSumAdjustment are recomputed.
+ */
+QByteArray
+renameFont(const QByteArray& font, const QString& family) {
+    const quint32 version = font.length() >= 12 ? get32(font, 0) : 0;
+    if (version != 0x10000 && version != 0x4f54544f /* OTTO */
+            && version != 0x74727565 /* true */) {
+        return QByteArray();
+    }
+    const int numTables = get16(font, 4);
+    if (font.length() < 12 + 16 * numTables) {
+        return QByteArray();
+    }
+    int record = -1;
+    for (int i = 0; i < numTables; ++i) {
+        if (font.mid(12 + 16 * i, 4) == "name") {
+            record = 12 + 16 * i;
+        }
+    }
+    if (record == -1) {
+        return QByteArray();
+    }
+    const quint32 offset = get32(font, record + 8);
+    const quint32 length = get32(font, record + 12);
+    if (offset > quint32(font.length()) || length < 6
+            || length > font.length() - offset) {
+        return QByteArray();
+    }
+    const QByteArray name = font.mid(offset, length);
+    const int count = get16(name, 2);
+    const int storage = get16(name, 4);
+    if (6 + 12 * count > name.length() || storage > name.length()) {
+        return QByteArray();
+    }
+    // the names that fonts are looked up by; the others are kept
+    QByteArray utf16;
+    foreach (QChar c, family) {
+        put16(utf16, c.unicode());
+    }
+    const QByteArray latin1 = family.toLatin1();
+    QByteArray records;
+    QByteArray strings;
+    for (int i = 0; i < count; ++i) {
+        const int r = 6 + 12 * i;
+        const int platform = get16(name, r);
+        const int nameId = get16(name, r + 6);
+        QByteArray string = name.mid(storage + get16(name, r + 10),
+                                     get16(name, r + 8));
+        if (nameId == 1 || nameId == 3 || nameId == 4 || nameId == 6
+                || nameId == 16) {
+            string = platform == 1 ? latin1 : utf16;
+        }
+        records.append(name.mid(r, 8));
+        put16(records, string.length());
+        put16(records, strings.length());
+        strings.append(string);
+    }
+    QByteArray table;
+    put16(table, 0);
+    put16(table, count);
+    put16(table, 6 + records.length());
+    table += records + strings;
+
+    QByteArray renamed = font.left(12);
+    QByteArray tables;
+    int head = -1;
+    const int start = 12 + 16 * numTables;
+    for (int i = 0; i < numTables; ++i) {
+        const int r = 12 + 16 * i;
+        QByteArray data = table;
+        if (r != record) {
+            const quint32 o = get32(font, r + 8);
+            const quint32 l = get32(font, r + 12);
+            if (o > quint32(font.length()) || l > font.length() - o) {
+                return QByteArray();
+            }
+            data = font.mid(o, l);
+        }
+        if (font.mid(r, 4) == "head") {
+            if (data.length() < 12) {
+                return QByteArray();
+            }
+            // the adjustment is summed as 0
+            set32(data, 8, 0);
+            head = start + tables.length();
+        }
+        renamed.append(font.mid(r, 4));
+        put32(renamed, tableChecksum(data));
+        put32(renamed, start + tables.length());
+        put32(renamed, data.length());
+        tables.append(data);
+        tables.append(QByteArray((4 - tables.length() % 4) % 4, '\0'));
+    }
+    renamed.append(tables);
+    if (head != -1) {
+        set32(renamed, head + 8, 0xB1B0AFBA - tableChecksum(renamed));
+    }
+    return renamed;
+}
+
+// file access for one asynchronous request, run on the thread pool
+class IOTask : public QRunnable {
+private:
+    NativeIO* const nativeio;
+    FileCache* const files;
+    TextDecoder* const decoder;
+    const int id;
+    const NativeIO::RequestType type;
+    const QString path;
+    const QString encoding;
+    const qint64 offset;
+    const qint64 length;
+    const QByteArray input;
+public:
+    IOTask(NativeIO* nativeio_, FileCache* files_, TextDecoder* decoder_,
+           int id_, NativeIO::RequestType type_,
+           const QString& path_, const QString& encoding_ = QString(),
+           qint64 offset_ = 0, qint64 length_ = -1,
+           const QByteArray& input_ = QByteArray())
+        :nativeio(nativeio_), files(files_), decoder(decoder_), id(id_),
+          type(type_), path(path_), encoding(encoding_), offset(offset_),
+          length(length_), input(input_) {
+    }
+    void run() {
+        QString err;
+        QByteArray data;
+        QString text;
+        if (type == NativeIO::Write) {
+            QSaveFile out(path);
+            if (!out.open(QIODevice::WriteOnly)) {
+                err = "Could not open file for writing.";
+            } else if (out.write(input) != input.length() || !out.commit()) {
+                err = "Could not write to file.";
+            }
+            // a read that ran meanwhile may have cached the old file
+            files->invalidate(path);
+        } else if (!files->read(path, offset, length, data)) {
+            err = "Could not read file.";
+            data.clear();
+        } else if (length >= 0 && length != data.length()) {
+            err = "Not enough data: " + QString::number(length) +
+                    " instead of " + QString::number(data.length());
+            data.clear();
+        }
+        if (type == NativeIO::ReadText && err.isNull()) {
+            text = decoder->decode(data, encoding);
+            data.clear();
+        }
+        QMetaObject::invokeMethod(nativeio, "finishRequest",
+                Qt::QueuedConnection, Q_ARG(int, id), Q_ARG(int, type),
+                Q_ARG(QString, err), Q_ARG(QByteArray, data),
+                Q_ARG(QString, text));
+    }
+};
+
+}
 
 NativeIO::NativeIO(QObject* parent, const QDir& runtimedir_,
          const QDir& cwd_,
          const QMap<QString, QFile::Permissions>& pathPermissions_)
     :QObject(parent), runtimedir(runtimedir_), cwd(cwd_),
-      pathPermissions(pathPermissions_) {
+      pathPermissions(pathPermissions_), lastRequestId(0),
+      pendingRequests(0), lastWriterId(0), lastSpanId(0), thumbnail(0) {
+}
+bool
+NativeIO::mayWrite(const QString& path) const {
+    if (pathPermissions.isEmpty()) {
+        return true;
+    }
+    // the most specific entry that contains path decides
+    QString match;
+    QFile::Permissions permissions;
+    PathMap::const_iterator i = pathPermissions.constBegin();
+    for (; i != pathPermissions.constEnd(); ++i) {
+        const QString dir = cwd.absoluteFilePath(i.key());
+        if ((path == dir || path.startsWith(dir + "/"))
+                && dir.length() > match.length()) {
+            match = dir;
+            permissions = i.value();
+        }
+    }
+    return permissions & QFile::WriteUser;
+}
+NativeIO::~NativeIO() {
+    pool.waitForDone();
+    // uncommitted writes are discarded
+    foreach (const Writer& w, writers) {
+        delete w.file;
+    }
 }
 QString
 NativeIO::readFileSync(const QString& path, const QString& encoding) {
@@ -20,65 +254,215 @@ NativeIO::readFileSync(const QString& path, const QString& encoding) {
         errstr = "Could not read file.";
         return QString();
     }
-    QString out;
-    if (encoding != "binary") {
-        QTextCodec *codec = QTextCodec::codecForName(encoding.toLatin1());
-        if (codec) {
-            out = codec->toUnicode(data);
+    return decoder.decode(data, encoding);
+}
+QVariantList
+NativeIO::readMany(const QStringList& paths, const QString& encoding) {
+    QVariantList contents;
+    QStringList failed;
+    foreach (const QString& path, paths) {
+        QFile file(cwd.absoluteFilePath(path));
+        if (file.open(QIODevice::ReadOnly)) {
+            contents.append(decoder.decode(file.readAll(), encoding));
+        } else {
+            contents.append(QVariant());
+            failed.append(path);
         }
     }
-    if (out.length() == 0 && data.length() > 0) {
-        out = QString(data.length(), 0);
-        for (int i = 0; i < data.length(); ++i) {
-            out[i] = data[i];
-        }
+    errstr = failed.isEmpty() ? QString()
+            : "Could not read " + failed.join(", ") + ".";
+    return contents;
+}
+QByteArray
+NativeIO::readFileBinary(const QString& path) {
+    errstr = QString();
+    QByteArray data;
+    if (!files.read(cwd.absoluteFilePath(path), 0, -1, data)) {
+        errstr = "Could not read file.";
+        return QByteArray();
     }
-    return out;
+    return data;
 }
-QString
-NativeIO::read(const QString& path, int offset, int length) {
+QByteArray
+NativeIO::readBinary(const QString& path, int offset, int length) {
     errstr = QString();
-    QFile file(cwd.absoluteFilePath(path));
     QByteArray data;
-    if (file.open(QIODevice::ReadOnly) && (offset == 0 || file.seek(offset))) {
-        int lastLength = 0;
-        do {
-            lastLength = data.length();
-            data += file.read(length - data.length());
-        } while (data.length() < length && data.length() != lastLength);
+    if (!files.read(cwd.absoluteFilePath(path), offset, length, data)) {
+        data.clear();
     }
     if (length != data.length()) {
         errstr = "Not enough data: " + QString::number(length) +
                 " instead of " + QString::number(data.length());
-        return QString();
+        return QByteArray();
     }
-    QString out(length, 0);
-    for (int i = 0; i < length; ++i) {
-        out[i] = data[i];
+    return data;
+}
+QString
+NativeIO::read(const QString& path, int offset, int length) {
+    QByteArray data = readBinary(path, offset, length);
+    if (!errstr.isNull()) {
+        return QString();
     }
-    return out;
+    return QString::fromLatin1(data);
 }
 void
 NativeIO::writeFile(const QString& path, const QString& data) {
-    QFile file(cwd.absoluteFilePath(path));
-    errstr = QString();
-    if (!file.open(QIODevice::WriteOnly)) {
-        errstr = "Could not open file for writing.";
-        return;
-    }
-    int length = data.length();
+    // every character is one byte; like before, only its low byte is kept,
+    // where toLatin1 would turn characters above 0xFF into '?'
+    const int length = data.length();
     QByteArray out(length, 0);
     for (int i = 0; i < length; ++i) {
         out[i] = data[i].unicode();
     }
-    if (file.write(out) != out.length()) {
+    const int writer = openWrite(path);
+    if (writer && appendWrite(writer, out)) {
+        commitWrite(writer);
+    }
+}
+int
+NativeIO::openWrite(const QString& path, bool sync) {
+    errstr = QString();
+    Writer w;
+    w.path = cwd.absoluteFilePath(path);
+    if (!mayWrite(w.path)) {
+        errstr = "Writing to " + path + " is not allowed.";
+        return 0;
+    }
+    files.invalidate(w.path);
+    if (sync) {
+        w.file = new QSaveFile(w.path);
+    } else {
+        // in the same directory, so the rename does not cross file systems
+        QTemporaryFile* tmp = new QTemporaryFile(w.path + ".XXXXXX");
+        w.file = tmp;
+        if (tmp->open()) {
+            // QTemporaryFile is only readable by the owner
+            tmp->setPermissions(QFile::exists(w.path)
+                    ? QFile::permissions(w.path)
+                    : QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup
+                      | QFile::ReadOther);
+        }
+    }
+    if (!w.file->isOpen() && !w.file->open(QIODevice::WriteOnly)) {
+        errstr = "Could not open file for writing.";
+        delete w.file;
+        return 0;
+    }
+    writers.insert(++lastWriterId, w);
+    return lastWriterId;
+}
+bool
+NativeIO::appendWrite(int writer, const QByteArray& data) {
+    errstr = QString();
+    QFileDevice* file = writers.value(writer).file;
+    if (!file) {
+        errstr = "Unknown writer.";
+        return false;
+    }
+    if (file->write(data) != data.length()) {
         errstr = "Could not write to file.";
+        abortWrite(writer);
+        return false;
+    }
+    return true;
+}
+bool
+NativeIO::commitWrite(int writer) {
+    errstr = QString();
+    if (!writers.contains(writer)) {
+        errstr = "Unknown writer.";
+        return false;
+    }
+    const Writer w = writers.take(writer);
+    QSaveFile* save = qobject_cast<QSaveFile*>(w.file);
+    if (save) {
+        // QSaveFile syncs the temporary file to disk before renaming it
+        if (!save->commit()) {
+            errstr = "Could not write to file.";
+        }
+    } else {
+        // rename() replaces an existing file atomically, QFile::rename
+        // would not replace it at all
+        QTemporaryFile* tmp = static_cast<QTemporaryFile*>(w.file);
+        const bool flushed = tmp->flush();
+        tmp->close();
+        if (!flushed || ::rename(QFile::encodeName(tmp->fileName()),
+                                 QFile::encodeName(w.path)) != 0) {
+            errstr = "Could not write to file.";
+        } else {
+            tmp->setAutoRemove(false);
+        }
+    }
+    files.invalidate(w.path);
+    delete w.file;
+    return errstr.isNull();
+}
+void
+NativeIO::abortWrite(int writer) {
+    QFileDevice* file = writers.take(writer).file;
+    QSaveFile* save = qobject_cast<QSaveFile*>(file);
+    if (save) {
+        save->cancelWriting();
+    }
+    // a QTemporaryFile removes itself
+    delete file;
+}
+int
+NativeIO::startRequest(QRunnable* task) {
+    pendingRequests += 1;
+    pool.start(task);
+    return lastRequestId;
+}
+int
+NativeIO::readFileAsync(const QString& path, const QString& encoding) {
+    ++lastRequestId;
+    RequestType type = encoding == "binary" ? ReadBinary : ReadText;
+    return startRequest(new IOTask(this, &files, &decoder, lastRequestId,
+            type, cwd.absoluteFilePath(path), encoding));
+}
+int
+NativeIO::readAsync(const QString& path, int offset, int length) {
+    ++lastRequestId;
+    return startRequest(new IOTask(this, &files, &decoder, lastRequestId,
+            ReadBinary, cwd.absoluteFilePath(path), QString(), offset,
+            length));
+}
+int
+NativeIO::writeFileAsync(const QString& path, const QByteArray& data) {
+    ++lastRequestId;
+    if (!mayWrite(cwd.absoluteFilePath(path))) {
+        // reported like any other failed request, from the event loop
+        pendingRequests += 1;
+        QMetaObject::invokeMethod(this, "finishRequest", Qt::QueuedConnection,
+                Q_ARG(int, lastRequestId), Q_ARG(int, Write),
+                Q_ARG(QString, "Writing to " + path + " is not allowed."),
+                Q_ARG(QByteArray, QByteArray()), Q_ARG(QString, QString()));
+        return lastRequestId;
+    }
+    files.invalidate(cwd.absoluteFilePath(path));
+    return startRequest(new IOTask(this, &files, &decoder, lastRequestId,
+            Write, cwd.absoluteFilePath(path), QString(), 0, -1, data));
+}
+void
+NativeIO::finishRequest(int id, int type, const QString& err,
+                        const QByteArray& data, const QString& text) {
+    pendingRequests -= 1;
+    if (type == ReadText) {
+        emit readTextFinished(id, err, text);
+    } else if (type == ReadBinary) {
+        emit readFinished(id, err, data);
+    } else {
+        emit writeFinished(id, err);
     }
-    return;
 }
 void
 NativeIO::unlink(const QString& path) {
     errstr = QString();
+    if (!mayWrite(cwd.absoluteFilePath(path))) {
+        errstr = "Deleting " + path + " is not allowed.";
+        return;
+    }
+    files.invalidate(cwd.absoluteFilePath(path));
     QFile file(cwd.absoluteFilePath(path));
     if (!file.exists()) {
         errstr = "File does not exist.";
@@ -112,3 +496,57 @@ NativeIO::libraryPaths() const {
     paths << runtimedir.absolutePath() << cwd.absolutePath();
     return paths;
 }
+QStringList
+NativeIO::registerFont(const QByteArray& data) {
+    // font hash -> application font id, shared by all pages and jobs
+    static QHash<QByteArray, int> fonts;
+    errstr = QString();
+    const QByteArray hash = QCryptographicHash::hash(data,
+            QCryptographicHash::Sha1).toHex();
+    // each font file gets a family of its own, so documents that embed
+    // different fonts under one name, or fonts registered for earlier
+    // jobs, cannot take each other's place
+    const QString family = "webodf-" + QString::fromLatin1(hash.left(20));
+    QHash<QByteArray, int>::const_iterator i = fonts.constFind(hash);
+    int id;
+    if (i != fonts.constEnd()) {
+        id = i.value();
+    } else {
+        const QByteArray renamed = renameFont(data, family);
+        id = renamed.isEmpty() ? -1
+                : QFontDatabase::addApplicationFontFromData(renamed);
+        fonts.insert(hash, id);
+    }
+    if (id == -1 || !QFontDatabase::applicationFontFamilies(id)
+            .contains(family)) {
+        errstr = "Could not register font.";
+        return QStringList();
+    }
+    return QStringList(family);
+}
+bool
+NativeIO::tracing() const {
+    return Tracer::instance() != 0;
+}
+int
+NativeIO::beginSpan(const QString& name, const QString& category) {
+    if (!Tracer::instance()) {
+        return 0;
+    }
+    Span span;
+    span.name = name;
+    span.category = category.isEmpty() ? QString("js") : category;
+    span.start = Tracer::instance()->now();
+    spans[++lastSpanId] = span;
+    return lastSpanId;
+}
+void
+NativeIO::endSpan(int id) {
+    if (!spans.contains(id)) {
+        return;
+    }
+    const Span span = spans.take(id);
+    if (Tracer::instance()) {
+        Tracer::instance()->addSpan(span.name, span.category, span.start);
+    }
+}
@@ -1,9 +1,14 @@
 #ifndef NATIVEIO_H
 #define NATIVEIO_H
 
+#include "filecache.h"
+#include "textdecoder.h"
 #include <QFile>
 #include <QDir>
 #include <QMap>
+#include <QSaveFile>
+#include <QSize>
+#include <QThreadPool>
 
 class QWebPage;
 
@@ -16,11 +21,59 @@ private:
     const QDir runtimedir;
     const QDir cwd;
     const QMap<QString, QFile::Permissions> pathPermissions;
+    FileCache files;
+    TextDecoder decoder;
+    QThreadPool pool;
+    int lastRequestId;
+    int pendingRequests;
+    int lastWriterId;
+    // a file that is written in chunks; without sync it is a QTemporaryFile
+    // next to path that is renamed over it on commit
+    struct Writer {
+        QFileDevice* file;
+        QString path;
+        Writer() :file(0) {}
+    };
+    QMap<int, Writer> writers;
+    struct Span {
+        QString name;
+        QString category;
+        qint64 start;
+    };
+    int lastSpanId;
+    QMap<int, Span> spans;
+    double thumbnail;
+    int startRequest(QRunnable* task);
+    // true if pathPermissions allow writing the file at absolute path; with
+    // no pathPermissions everything may be written
+    bool mayWrite(const QString& path) const;
 public:
     typedef QMap<QString, QFile::Permissions> PathMap;
     PathMap v;
     NativeIO(QObject* parent, const QDir& runtimedir, const QDir& cwd,
              const PathMap& pathPermissions = PathMap());
+    ~NativeIO();
+    /**
+     * Return true while asynchronous requests have not reported back yet.
+     */
+    bool hasPendingRequests() const {
+        return pendingRequests > 0;
+    }
+    /**
+     * Set the size of the thumbnail that the page is exported as, or an
+     * invalid size if it is not.
+     */
+    void setThumbnailSize(const QSize& size) {
+        thumbnail = size.isValid() ? double(size.height()) / size.width() : 0;
+    }
+    /**
+     * Pass a daemon job to the page.
+     */
+    void startJob(const QVariantMap& job) {
+        emit jobStarted(job);
+    }
+    // type of an asynchronous request, passed back to finishRequest
+    enum RequestType { ReadText, ReadBinary, Write };
 public slots:
     /**
      * Return the last error.
@@ -29,13 +82,102 @@ public slots:
         return errstr;
     }
     QString readFileSync(const QString& path, const QString& encoding);
+    /**
+     * Read and decode several files in one call. Files that cannot be read
+     * give a null entry and set the error.
+     */
+    QVariantList readMany(const QStringList& paths, const QString& encoding);
     QString read(const QString& path, int offset, int length);
+    /**
+     * Read a whole file as raw bytes. The bridge hands the QByteArray to
+     * JavaScript as a typed array, so no per-byte widening is needed.
+     */
+    QByteArray readFileBinary(const QString& path);
+    /**
+     * Read length bytes at offset as raw bytes.
+     */
+    QByteArray readBinary(const QString& path, int offset, int length);
     void writeFile(const QString& path, const QString& data);
+    /**
+     * Asynchronous variants of the above. The file access runs on a thread
+     * pool and the returned request id is passed to readFinished,
+     * readTextFinished or writeFinished when it is done.
+     */
+    int readFileAsync(const QString& path, const QString& encoding);
+    int readAsync(const QString& path, int offset, int length);
+    int writeFileAsync(const QString& path, const QByteArray& data);
+    /**
+     * Start writing a file in chunks and return a writer id, or 0 if the
+     * file cannot be created. The data goes to a temporary file that only
+     * replaces path on commitWrite, so a failed write leaves no partial file.
+     * With sync off, the data is not flushed to disk before the rename.
+     */
+    int openWrite(const QString& path, bool sync = true);
+    bool appendWrite(int writer, const QByteArray& data);
+    /**
+     * Atomically rename the written data to the target path, after flushing
+     * it to disk if the writer was opened with sync.
+     */
+    bool commitWrite(int writer);
+    /**
+     * Discard the data of a writer; the target file is left untouched.
+     */
+    void abortWrite(int writer);
     void unlink(const QString& path);
     int getFileSize(const QString& path);
     void exit(int exitcode);
+    /**
+     * Tell the runtime that the page is ready. The page is exported
+     * without waiting for it to settle and status becomes the exit code.
+     */
+    void done(int status) {
+        emit completed(status);
+    }
+    /**
+     * Return the height of the thumbnail relative to its width, or 0 if the
+     * page is not exported as a thumbnail. Only that much of the top of the
+     * page needs to be laid out.
+     */
+    double thumbnailRatio() const {
+        return thumbnail;
+    }
     QString currentDirectory() const;
     QStringList libraryPaths() const;
+    /**
+     * Return counters of how file contents were decoded to strings.
+     */
+    QVariantMap decodeStatistics() const {
+        return decoder.statistics();
+    }
+    /**
+     * Register a font for the whole process and return the family it can
+     * be used by. The family is derived from a hash of the font's bytes,
+     * so only documents that embed the same font file share it.
+     */
+    QStringList registerFont(const QByteArray& data);
+    /**
+     * Return true if the runtime writes a trace, so pages can skip the
+     * cost of their spans otherwise.
+     */
+    bool tracing() const;
+    /**
+     * Start a span in the trace and return its id for endSpan. Returns 0 if
+     * tracing is off.
+     */
+    int beginSpan(const QString& name, const QString& category);
+    /**
+     * End the span with the given id and add it to the trace.
+     */
+    void endSpan(int id);
+signals:
+    void readFinished(int id, const QString& err, const QByteArray& data);
+    void readTextFinished(int id, const QString& err, const QString& data);
+    void writeFinished(int id, const QString& err);
+    void completed(int status);
+    void jobStarted(const QVariantMap& job);
+private slots:
+    void finishRequest(int id, int type, const QString& err,
+                       const QByteArray& data, const QString& text);
 };
 
 #endif
@@ -0,0 +1,303 @@
+#include "nativezip.h"
+#include "zippackage.h"
+#include "zipwriter.h"
+#include <QFileInfo>
+#include <zlib.h>
+
+namespace {
+
+// table that maps 12 bits of input to two base64 characters
+struct Base64Table {
+    ushort pairs[4096];
+    Base64Table() {
+        const char alphabet[] =
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                "0123456789+/";
+        for (int i = 0; i < 4096; ++i) {
+            pairs[i] = (alphabet[i >> 6] << 8) | alphabet[i & 0x3f];
+        }
+    }
+};
+
+/**
+ * Base64 encode data and append it to out. The characters are written
+ * straight into the UTF-16 buffer of the string, two per table lookup.
+ */
+void
+appendBase64(QString& out, const QByteArray& data) {
+    static const Base64Table table;
+    const uchar* in = reinterpret_cast<const uchar*>(data.constData());
+    const int n = data.length();
+    const int start = out.length();
+    out.resize(start + (n + 2) / 3 * 4);
+    ushort* o = reinterpret_cast<ushort*>(out.data()) + start;
+    int i = 0;
+    for (; i + 3 <= n; i += 3) {
+        const uint v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        const ushort a = table.pairs[v >> 12];
+        const ushort b = table.pairs[v & 0xfff];
+        o[0] = a >> 8;
+        o[1] = a & 0xff;
+        o[2] = b >> 8;
+        o[3] = b & 0xff;
+        o += 4;
+    }
+    if (i < n) {
+        const uint v = (in[i] << 16) | (i + 1 < n ? in[i + 1] << 8 : 0);
+        const ushort a = table.pairs[v >> 12];
+        const ushort b = table.pairs[v & 0xfff];
+        o[0] = a >> 8;
+        o[1] = a & 0xff;
+        o[2] = i + 1 < n ? b >> 8 : '=';
+        o[3] = '=';
+    }
+}
+
+QString
+guessMimetype(const QByteArray& data) {
+    const uchar* p = reinterpret_cast<const uchar*>(data.constData());
+    if (data.length() < 4) {
+        return QString();
+    }
+    if (p[1] == 0x50 && p[2] == 0x4E && p[3] == 0x47) {
+        return "image/png";
+    }
+    if (p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF) {
+        return "image/jpeg";
+    }
+    if (p[0] == 0x47 && p[1] == 0x49 && p[2] == 0x46) {
+        return "image/gif";
+    }
+    return QString();
+}
+
+}
+
+NativeZip::NativeZip(QObject* parent, const QDir& cwd_)
+    :QObject(parent), cwd(cwd_), maxOpenPackages(16), lastId(0),
+      compressionLevel(Z_DEFAULT_COMPRESSION), lastWriterId(0) {
+}
+NativeZip::~NativeZip() {
+    qDeleteAll(writers);
+    qDeleteAll(openPackages);
+}
+ZipPackage*
+NativeZip::package(int id) {
+    ZipPackage* p = openPackages.value(id);
+    if (p) {
+        lru.removeOne(id);
+        lru.prepend(id);
+        return p;
+    }
+    if (!handles.contains(id)) {
+        return 0;
+    }
+    const Handle& h = handles[id];
+    p = new ZipPackage(h.path);
+    if (!p->isValid() || p->fileSize() != h.size
+            || p->lastModified() != h.modified) {
+        delete p;
+        return 0;
+    }
+    openPackages.insert(id, p);
+    lru.prepend(id);
+    while (lru.size() > maxOpenPackages) {
+        delete openPackages.take(lru.takeLast());
+    }
+    return p;
+}
+int
+NativeZip::open(const QString& path) {
+    errstr = QString();
+    const QString absPath = cwd.absoluteFilePath(path);
+    const QFileInfo info(absPath);
+    // reuse the index if the same unchanged package was opened before
+    QMap<int, Handle>::iterator i;
+    for (i = handles.begin(); i != handles.end(); ++i) {
+        if (i.value().path == absPath && i.value().size == info.size()
+                && i.value().modified == info.lastModified()
+                && package(i.key())) {
+            i.value().refs += 1;
+            return i.key();
+        }
+    }
+    ZipPackage* p = new ZipPackage(absPath);
+    if (!p->isValid()) {
+        errstr = p->error();
+        delete p;
+        return 0;
+    }
+    const int id = ++lastId;
+    Handle h;
+    h.path = absPath;
+    h.size = p->fileSize();
+    h.modified = p->lastModified();
+    h.refs = 1;
+    handles.insert(id, h);
+    openPackages.insert(id, p);
+    lru.prepend(id);
+    while (lru.size() > maxOpenPackages) {
+        delete openPackages.take(lru.takeLast());
+    }
+    return id;
+}
+void
+NativeZip::close(int id) {
+    QMap<int, Handle>::iterator i = handles.find(id);
+    if (i == handles.end() || --i.value().refs > 0) {
+        return;
+    }
+    handles.erase(i);
+    lru.removeOne(id);
+    delete openPackages.take(id);
+}
+QVariantList
+NativeZip::entries(int id) {
+    errstr = QString();
+    QVariantList list;
+    ZipPackage* p = package(id);
+    if (!p) {
+        errstr = "Package is not available.";
+        return list;
+    }
+    foreach (const ZipPackage::Entry& e, p->entries()) {
+        QVariantMap m;
+        m.insert("filename", e.name);
+        m.insert("date", e.date());
+        m.insert("compressed", e.isCompressed());
+        list.append(m);
+    }
+    return list;
+}
+QByteArray
+NativeZip::load(int id, const QString& filename) {
+    errstr = QString();
+    QByteArray data;
+    ZipPackage* p = package(id);
+    const ZipPackage::Entry* e = p ? p->entry(filename) : 0;
+    if (!e) {
+        errstr = filename + " not found.";
+    } else if (!p->read(*e, data)) {
+        errstr = "Could not read " + filename + ".";
+    }
+    return data;
+}
+QString
+NativeZip::loadAsString(int id, const QString& filename) {
+    const QByteArray data = load(id, filename);
+    if (!errstr.isNull()) {
+        return QString();
+    }
+    return QString::fromUtf8(data);
+}
+QString
+NativeZip::loadAsDataURL(int id, const QString& filename,
+                         const QString& mimetype) {
+    const QByteArray data = load(id, filename);
+    if (!errstr.isNull()) {
+        return QString();
+    }
+    QString url = "data:" + (mimetype.isEmpty() ? guessMimetype(data)
+                                                : mimetype) + ";base64,";
+    appendBase64(url, data);
+    return url;
+}
+QString
+NativeZip::entryURL(int id, const QString& filename) {
+    errstr = QString();
+    ZipPackage* p = package(id);
+    if (!p || !p->entry(filename)) {
+        errstr = filename + " not found.";
+        return QString();
+    }
+    const QString url = packageURL(id, filename).toString(QUrl::FullyEncoded);
+    // the request for the url has to find the entry again
+    int parsedId;
+    QString parsedName;
+    if (!parsePackageURL(QUrl(url), parsedId, parsedName) || parsedId != id
+            || parsedName != filename) {
+        errstr = "Cannot make a url for " + filename + ".";
+        return QString();
+    }
+    return url;
+}
+QUrl
+NativeZip::packageURL(int id, const QString& filename) {
+    QUrl url;
+    url.setScheme("odfpkg");
+    url.setHost("pkg" + QString::number(id));
+    url.setPath("/" + filename);
+    return url;
+}
+bool
+NativeZip::parsePackageURL(const QUrl& url, int& id, QString& filename) {
+    const QString host = url.host();
+    bool ok = false;
+    id = host.startsWith("pkg") ? host.mid(3).toInt(&ok) : 0;
+    filename = url.path(QUrl::FullyDecoded).mid(1);
+    return url.scheme() == "odfpkg" && ok && id > 0 && !filename.isEmpty();
+}
+int
+NativeZip::beginPackage(const QString& path) {
+    errstr = QString();
+    ZipWriter* writer = new ZipWriter(cwd.absoluteFilePath(path),
+                                      compressionLevel);
+    if (!writer->error().isNull()) {
+        errstr = writer->error();
+        delete writer;
+        return 0;
+    }
+    writers.insert(++lastWriterId, writer);
+    return lastWriterId;
+}
+void
+NativeZip::addEntry(int writer, const QString& filename,
+                    const QByteArray& data, bool compressed,
+                    const QDateTime& date) {
+    ZipWriter* w = writers.value(writer);
+    if (w) {
+        w->add(filename, data, compressed, date);
+    }
+}
+bool
+NativeZip::copyEntry(int writer, int id, const QString& filename) {
+    errstr = QString();
+    ZipWriter* w = writers.value(writer);
+    ZipPackage* p = package(id);
+    const ZipPackage::Entry* e = p ? p->entry(filename) : 0;
+    QByteArray data;
+    if (!w) {
+        errstr = "Unknown package writer.";
+    } else if (!e) {
+        errstr = filename + " not found.";
+    } else if (filename == "mimetype" && e->isCompressed()) {
+        // the mimetype entry has to be stored uncompressed
+        if (p->read(*e, data)) {
+            w->add(filename, data, false, e->date());
+        } else {
+            errstr = "Could not read " + filename + ".";
+        }
+    } else if (p->readRaw(*e, data)) {
+        w->addRaw(filename, data, e->method, e->crc, e->size, e->date());
+    } else {
+        errstr = "Could not read " + filename + ".";
+    }
+    return errstr.isNull();
+}
+bool
+NativeZip::finishPackage(int writer) {
+    errstr = QString();
+    ZipWriter* w = writers.take(writer);
+    if (!w) {
+        errstr = "Unknown package writer.";
+        return false;
+    }
+    const bool ok = w->finish();
+    errstr = w->error();
+    delete w;
+    return ok;
+}
+void
+NativeZip::cancelPackage(int writer) {
+    delete writers.take(writer);
+}
@@ -0,0 +1,120 @@
+#ifndef NATIVEZIP_H
+#define NATIVEZIP_H
+
+#include <QDateTime>
+#include <QDir>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QUrl>
+#include <QVariant>
+
+class ZipPackage;
+class ZipWriter;
+
+// class that exposes native reading of zip packages to web environment
+class NativeZip : public QObject {
+Q_OBJECT
+private:
+    struct Handle {
+        QString path;
+        qint64 size;
+        QDateTime modified;
+        // number of open() calls that returned this handle
+        int refs;
+    };
+    QString errstr;
+    const QDir cwd;
+    const int maxOpenPackages;
+    int lastId;
+    QMap<int, Handle> handles;
+    QMap<int, ZipPackage*> openPackages;
+    QList<int> lru;
+    int compressionLevel;
+    int lastWriterId;
+    QMap<int, ZipWriter*> writers;
+public:
+    NativeZip(QObject* parent, const QDir& cwd);
+    ~NativeZip();
+    /**
+     * Set the zlib compression level used for writing packages.
+     */
+    void setCompressionLevel(int level) {
+        compressionLevel = level;
+    }
+    /**
+     * Return the package for a handle, reopening it if it was closed to
+     * limit the number of open files. Returns 0 if the package is unknown
+     * or was changed on disk.
+     */
+    ZipPackage* package(int id);
+    /**
+     * Return the odfpkg://pkg<id>/<entry> url for an entry. The id is not
+     * the bare host, as QUrl would read an all-digit host as an IPv4
+     * address.
+     */
+    static QUrl packageURL(int id, const QString& filename);
+    /**
+     * Split a url made by packageURL into package id and entry name.
+     * Returns false if it is not such a url.
+     */
+    static bool parsePackageURL(const QUrl& url, int& id, QString& filename);
+public slots:
+    /**
+     * Return the last error.
+     */
+    QString error() {
+        return errstr;
+    }
+    /**
+     * Index the package at path and return a handle for it, or 0 if it
+     * cannot be read as a zip file.
+     */
+    int open(const QString& path);
+    /**
+     * Release a handle from open(). The package is forgotten when every
+     * open() that returned the handle has been matched by a close().
+     */
+    void close(int id);
+    /**
+     * Return a list of {filename, date, compressed} objects.
+     */
+    QVariantList entries(int id);
+    QByteArray load(int id, const QString& filename);
+    QString loadAsString(int id, const QString& filename);
+    /**
+     * Return the entry as a base64 data URL. If mimetype is empty, it is
+     * guessed from the first bytes of the data.
+     */
+    QString loadAsDataURL(int id, const QString& filename,
+                          const QString& mimetype);
+    /**
+     * Return an odfpkg:// url for the entry, which the runtime serves from
+     * the package when the page loads it, or an empty string if there is no
+     * such entry or the name cannot be put in a url.
+     */
+    QString entryURL(int id, const QString& filename);
+    /**
+     * Start writing a package to path and return a handle for the writer.
+     * Entries are compressed in parallel as they are added.
+     */
+    int beginPackage(const QString& path);
+    void addEntry(int writer, const QString& filename, const QByteArray& data,
+                  bool compressed, const QDateTime& date);
+    /**
+     * Add an entry of the package id to the writer by copying its compressed
+     * bytes and crc verbatim, without inflating and deflating it again.
+     */
+    bool copyEntry(int writer, int id, const QString& filename);
+    /**
+     * Write all entries and replace the file at path with the new package.
+     * Returns false and sets the error if that fails.
+     */
+    bool finishPackage(int writer);
+    /**
+     * Discard a writer without touching the file at its path.
+     */
+    void cancelPackage(int writer);
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include "outputcache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QLockFile>
+#include <QMultiMap>
+#include <QSaveFile>
+#include <QTemporaryFile>
+
+#ifndef WEBODF_VERSION
+#define WEBODF_VERSION "unknown"
+#endif
+
+namespace {
+
+bool
+copyData(QIODevice& in, QIODevice& out) {
+    char buffer[65536];
+    qint64 n = in.read(buffer, sizeof(buffer));
+    while (n > 0) {
+        if (out.write(buffer, n) != n) {
+            return false;
+        }
+        n = in.read(buffer, sizeof(buffer));
+    }
+    return n == 0;
+}
+
+}
+
+OutputCache::OutputCache(const QString& path, qint64 maxSize_)
+        :dir(path), maxSize(maxSize_), hits(0), misses(0), stores(0),
+         evictions(0) {
+    dir.mkpath(".");
+}
+QByteArray
+OutputCache::key(const QStringList& files, const QString& format,
+                 const QVariantMap& options) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray(WEBODF_VERSION));
+    hash.addData("\n" + format.toUtf8() + "\n");
+    // QVariantMap iterates in key order, so equal options hash equally
+    QVariantMap::const_iterator i = options.constBegin();
+    for (; i != options.constEnd(); ++i) {
+        hash.addData(i.key().toUtf8() + "=" + i.value().toString().toUtf8()
+                     + "\n");
+    }
+    foreach (const QString& path, files) {
+        QFile file(path);
+        if (QFileInfo(path).isFile() && file.open(QIODevice::ReadOnly)) {
+            hash.addData(&file);
+        } else {
+            hash.addData(path.toUtf8());
+        }
+        hash.addData("\n");
+    }
+    return hash.result().toHex();
+}
+QString
+OutputCache::path(const QByteArray& key, const QString& format) const {
+    return dir.absoluteFilePath(QString::fromLatin1(key) + "." + format);
+}
+bool
+OutputCache::fetch(const QByteArray& key, const QString& format,
+                   const QString& output) {
+    const QString cached = path(key, format);
+    QFile in(cached);
+    if (!in.open(QIODevice::ReadOnly)) {
+        misses += 1;
+        count("misses", 1);
+        return false;
+    }
+    // an existing output is only replaced by a complete copy
+    QSaveFile out(output);
+    if (!out.open(QIODevice::WriteOnly) || !copyData(in, out)
+            || !out.commit()) {
+        return false;
+    }
+    in.close();
+    touch(cached);
+    hits += 1;
+    count("hits", 1);
+    return true;
+}
+bool
+OutputCache::store(const QByteArray& key, const QString& format,
+                   const QString& output) {
+    // copy to a temporary name first, so other processes never see a
+    // partial file
+    QTemporaryFile tmp(dir.absoluteFilePath("XXXXXX.tmp"));
+    QFile in(output);
+    if (!tmp.open() || !in.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    if (!copyData(in, tmp)) {
+        return false;
+    }
+    tmp.close();
+    const QString cached = path(key, format);
+    QFile::remove(cached);
+    if (!tmp.rename(cached)) {
+        return false;
+    }
+    tmp.setAutoRemove(false);
+    touch(cached);
+    stores += 1;
+    count("stores", 1);
+    evict();
+    return true;
+}
+QJsonObject
+OutputCache::loadIndex() const {
+    QFile file(dir.absoluteFilePath("statistics.json"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QJsonObject();
+    }
+    return QJsonDocument::fromJson(file.readAll()).object();
+}
+void
+OutputCache::saveIndex(const QJsonObject& index) {
+    QSaveFile file(dir.absoluteFilePath("statistics.json"));
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(index).toJson());
+        file.commit();
+    }
+}
+void
+OutputCache::touch(const QString& cached) {
+    // the last use is recorded in the index rather than as the
+    // modification time, which cannot be set before Qt 5.10
+    QLockFile lock(dir.absoluteFilePath("statistics.lock"));
+    if (!lock.lock()) {
+        return;
+    }
+    QJsonObject index = loadIndex();
+    QJsonObject lastUse = index.value("lastUse").toObject();
+    lastUse[QFileInfo(cached).fileName()] =
+            double(QDateTime::currentMSecsSinceEpoch());
+    index["lastUse"] = lastUse;
+    saveIndex(index);
+}
+void
+OutputCache::evict() {
+    int removed = 0;
+    {
+        QLockFile lock(dir.absoluteFilePath("statistics.lock"));
+        if (!lock.lock()) {
+            return;
+        }
+        QJsonObject index = loadIndex();
+        QJsonObject lastUse = index.value("lastUse").toObject();
+        // files without a recorded use go by their modification time
+        QMultiMap<qint64, QFileInfo> byUse;
+        foreach (const QFileInfo& info, dir.entryInfoList(QDir::Files)) {
+            if (info.fileName() == "statistics.json"
+                    || info.fileName() == "statistics.lock"
+                    || info.suffix() == "tmp") {
+                continue;
+            }
+            const QJsonValue used = lastUse.value(info.fileName());
+            byUse.insert(used.isDouble() ? qint64(used.toDouble())
+                    : info.lastModified().toMSecsSinceEpoch(), info);
+        }
+        // newest first
+        qint64 size = 0;
+        QMultiMap<qint64, QFileInfo>::const_iterator i = byUse.constEnd();
+        while (i != byUse.constBegin()) {
+            --i;
+            size += i.value().size();
+            if (size > maxSize
+                    && QFile::remove(i.value().absoluteFilePath())) {
+                lastUse.remove(i.value().fileName());
+                removed += 1;
+            }
+        }
+        if (removed) {
+            index["lastUse"] = lastUse;
+            saveIndex(index);
+        }
+    }
+    if (removed) {
+        evictions += removed;
+        count("evictions", removed);
+    }
+}
+void
+OutputCache::count(const char* counter, int n) {
+    // the totals over all processes that share the directory
+    QLockFile lock(dir.absoluteFilePath("statistics.lock"));
+    if (!lock.lock()) {
+        return;
+    }
+    QJsonObject index = loadIndex();
+    index[counter] = index.value(counter).toDouble() + n;
+    saveIndex(index);
+}
+QVariantMap
+OutputCache::statistics() const {
+    QVariantMap s;
+    s["hits"] = hits;
+    s["misses"] = misses;
+    s["stores"] = stores;
+    s["evictions"] = evictions;
+    s["hitRatio"] = hits + misses ? double(hits) / (hits + misses) : 0.0;
+    return s;
+}
@@ -0,0 +1,57 @@
+#ifndef OUTPUTCACHE_H
+#define OUTPUTCACHE_H
+
+#include <QByteArray>
+#include <QDir>
+#include <QJsonObject>
+#include <QStringList>
+#include <QVariantMap>
+
+// keeps exported files in a directory, named by a hash of everything that
+// determines their contents; the least recently used files are removed
+// when the directory grows beyond its maximum size
+class OutputCache {
+private:
+    QDir dir;
+    const qint64 maxSize;
+    int hits;
+    int misses;
+    int stores;
+    int evictions;
+    QString path(const QByteArray& key, const QString& format) const;
+    // statistics.json holds the counters of all processes that share the
+    // directory and the time of the last use of each file; it is only read
+    // and written under statistics.lock
+    QJsonObject loadIndex() const;
+    void saveIndex(const QJsonObject& index);
+    void touch(const QString& cached);
+    void evict();
+    void count(const char* counter, int n);
+public:
+    OutputCache(const QString& path, qint64 maxSize);
+    /**
+     * Return the key for output of the given format made from files with
+     * the given options. The key covers the contents of the files, the
+     * options and the webodf version. Entries of files that are not
+     * readable files are hashed as plain strings.
+     */
+    static QByteArray key(const QStringList& files, const QString& format,
+                          const QVariantMap& options);
+    /**
+     * Copy the cached output to output. Returns false on a miss, which
+     * leaves output as it was.
+     */
+    bool fetch(const QByteArray& key, const QString& format,
+               const QString& output);
+    /**
+     * Add the file output to the cache.
+     */
+    bool store(const QByteArray& key, const QString& format,
+               const QString& output);
+    /**
+     * Return the counters of this process.
+     */
+    QVariantMap statistics() const;
+};
+
+#endif
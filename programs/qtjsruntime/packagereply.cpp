@@ -0,0 +1,55 @@
+#include "packagereply.h"
+#include "zippackage.h"
+#include <QMimeDatabase>
+#include <cstring>
+
+PackageReply::PackageReply(QObject* parent, const QNetworkRequest& request,
+                           ZipPackage* package, const QString& filename)
+        :MemoryReply(parent, request), inflating(false) {
+    memset(&stream, 0, sizeof(stream));
+    const ZipPackage::Entry* entry = package ? package->entry(filename) : 0;
+    QString err;
+    if (!entry || !package->readRaw(*entry, raw)) {
+        err = filename + " not found.";
+    } else if (entry->method != 0 && entry->method != Z_DEFLATED) {
+        err = filename + " uses an unsupported compression method.";
+    } else if (entry->method == 0 && raw.length() != entry->size) {
+        // produce copies size bytes out of raw
+        err = filename + " is damaged.";
+    } else if (entry->method == Z_DEFLATED
+            && inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        err = "Cannot initialize zlib.";
+    }
+    if (!err.isNull()) {
+        raw.clear();
+        fail(ContentNotFoundError, err);
+        return;
+    }
+    if (entry->method == Z_DEFLATED) {
+        inflating = true;
+        stream.next_in = reinterpret_cast<Bytef*>(raw.data());
+        stream.avail_in = raw.length();
+    }
+    succeed(entry->size, QMimeDatabase().mimeTypeForFile(filename,
+            QMimeDatabase::MatchExtension).name());
+}
+PackageReply::~PackageReply() {
+    if (inflating) {
+        inflateEnd(&stream);
+    }
+}
+qint64
+PackageReply::produce(char* data, qint64 offset, qint64 maxSize) {
+    if (!inflating) {
+        memcpy(data, raw.constData() + offset, maxSize);
+        return maxSize;
+    }
+    stream.next_out = reinterpret_cast<Bytef*>(data);
+    stream.avail_out = maxSize;
+    const int result = inflate(&stream, Z_SYNC_FLUSH);
+    const qint64 inflated = maxSize - stream.avail_out;
+    if ((result != Z_OK && result != Z_STREAM_END) || inflated == 0) {
+        return -1;
+    }
+    return inflated;
+}
@@ -0,0 +1,31 @@
+#ifndef PACKAGEREPLY_H
+#define PACKAGEREPLY_H
+
+#include "memoryreply.h"
+#include <zlib.h>
+
+class ZipPackage;
+
+// serves an entry of a zip package for an odfpkg://pkg<id>/<entry> url;
+// compressed entries are inflated straight into the buffers of the reader,
+// so the inflated data is never held as a whole
+class PackageReply : public MemoryReply {
+Q_OBJECT
+private:
+    // the entry as it is stored in the package
+    QByteArray raw;
+    z_stream stream;
+    bool inflating;
+protected:
+    qint64 produce(char* data, qint64 offset, qint64 maxSize);
+public:
+    /**
+     * Create a reply for the given entry of package. If package is 0 or has
+     * no such entry, the reply fails with ContentNotFoundError.
+     */
+    PackageReply(QObject* parent, const QNetworkRequest& request,
+                 ZipPackage* package, const QString& filename);
+    ~PackageReply();
+};
+
+#endif
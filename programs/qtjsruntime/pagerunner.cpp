@@ -1,41 +1,145 @@
 #include "pagerunner.h"
 
+#include "memoryusage.h"
 #include "nam.h"
 #include "nativeio.h"
+#include "nativezip.h"
+#include "outputcache.h"
+#include "pdfmerger.h"
+#include "pngwriter.h"
+#include "tracer.h"
+#include "zippackage.h"
 #include <QFileInfo>
-#include <QTemporaryFile>
+#include <QImage>
+#include <QProcess>
 #include <QTimer>
 #include <QCoreApplication>
+#include <QPaintEngine>
 #include <QPainter>
 #include <QPrinter>
 #include <QWebFrame>
+#include <QWebSecurityOrigin>
+#include <QWebSettings>
 #include <QDebug>
+#include <climits>
 
-QByteArray getRuntimeBindings() {
-    return
+namespace {
+
+// paint engine that drops everything, for laying out a print without
+// producing output
+class NullPaintEngine : public QPaintEngine {
+public:
+    NullPaintEngine() :QPaintEngine(QPaintEngine::AllFeatures) {
+    }
+    bool begin(QPaintDevice*) {
+        return true;
+    }
+    bool end() {
+        return true;
+    }
+    Type type() const {
+        return QPaintEngine::User;
+    }
+    void updateState(const QPaintEngineState&) {}
+    void drawPixmap(const QRectF&, const QPixmap&, const QRectF&) {}
+    void drawImage(const QRectF&, const QImage&, const QRectF&,
+                   Qt::ImageConversionFlags) {}
+    void drawTiledPixmap(const QRectF&, const QPixmap&, const QPointF&) {}
+    void drawTextItem(const QPointF&, const QTextItem&) {}
+    void drawPath(const QPainterPath&) {}
+    void drawPolygon(const QPointF*, int, PolygonDrawMode) {}
+    void drawRects(const QRectF*, int) {}
+    void drawLines(const QLineF*, int) {}
+    void drawEllipse(const QRectF&) {}
+};
+
+// printer that only counts the pages QWebFrame::print starts; its page
+// geometry is that of a PDF printer
+class PageCounter : public QPrinter {
+private:
+    mutable NullPaintEngine engine;
+public:
+    int pages;
+    PageCounter() :QPrinter(QPrinter::HighResolution), pages(1) {
+        setOutputFormat(QPrinter::PdfFormat);
+    }
+    QPaintEngine* paintEngine() const {
+        return &engine;
+    }
+    bool newPage() {
+        pages += 1;
+        return true;
+    }
+};
+
+}
+
+const QByteArray& getRuntimeBindings() {
+    // built once and shared by all pages of the process
+    static const QByteArray bindings =
     "if (typeof(runtime) !== 'undefined' && typeof(nativeio) !== 'undefined') {"
+    // QByteArray arrives as a Uint8ClampedArray; a Uint8Array view on the
+    // same buffer avoids another copy
     "    runtime.readFileSync = function (path, encoding) {"
+    "        var data;"
+    "        if (encoding === 'binary') {"
+    "            data = nativeio.readFileBinary(path);"
+    "            return new Uint8Array(data.buffer, data.byteOffset, data.length);"
+    "        }"
     "        return nativeio.readFileSync(path, encoding);"
     "    };"
-    "    runtime.readFile = function (path, encoding, callback) {"
-    "        var data = nativeio.readFileSync(path, encoding),"
-    "            err = nativeio.error()||null;"
+    "    runtime.readFilesSync = function (paths, encoding) {"
+    "        var contents = nativeio.readMany(paths, encoding),"
+    "            err = nativeio.error();"
     "        if (err) {"
-    "            data = undefined;"
-    "        } else if (encoding === 'binary') {"
-    "            data = runtime.byteArrayFromString(data, 'binary');"
+    "            throw err;"
     "        }"
-    "        callback(nativeio.error()||null, data);"
-    "    };"
-    "    runtime.read = function (path, offset, length, callback) {"
-    "        var data = nativeio.read(path, offset, length);"
-    "        data = runtime.byteArrayFromString(data, 'binary');"
-    "        callback(nativeio.error()||null, data);"
+    "        return Array.prototype.slice.call(contents);"
     "    };"
+    "    (function () {"
+    "        var callbacks = {};"
+    "        function take(id) {"
+    "            var callback = callbacks[id];"
+    "            delete callbacks[id];"
+    "            return callback;"
+    "        }"
+    "        nativeio.readFinished.connect(function (id, err, data) {"
+    "            var callback = take(id);"
+    "            if (callback) {"
+    "                callback(err || null, err ? undefined"
+    "                    : new Uint8Array(data.buffer, data.byteOffset, data.length));"
+    "            }"
+    "        });"
+    "        nativeio.readTextFinished.connect(function (id, err, data) {"
+    "            var callback = take(id);"
+    "            if (callback) {"
+    "                callback(err || null, err ? undefined : data);"
+    "            }"
+    "        });"
+    "        runtime.readFile = function (path, encoding, callback) {"
+    "            callbacks[nativeio.readFileAsync(path, encoding)] = callback;"
+    "        };"
+    "        runtime.read = function (path, offset, length, callback) {"
+    "            callbacks[nativeio.readAsync(path, offset, length)] = callback;"
+    "        };"
+    "    }());"
+    // the data is handed over in chunks, so at most one chunk is copied at
+    // a time; the file only replaces path once it is complete
     "    runtime.writeFile = function (path, data, callback) {"
-    "        data = runtime.byteArrayToString(data, 'binary');"
-    "        nativeio.writeFile(path, data);"
-    "        callback(nativeio.error()||null);"
+    "        var writer = nativeio.openWrite(path),"
+    "            chunk = 1048576,"
+    "            i;"
+    "        for (i = 0; writer && i < data.length; i += chunk) {"
+    "            if (!nativeio.appendWrite(writer, new Uint8ClampedArray("
+    "                    data.buffer, data.byteOffset + i,"
+    "                    Math.min(chunk, data.length - i)))) {"
+    "                writer = 0;"
+    "            }"
+    "        }"
+    "        if (writer) {"
+    "            nativeio.commitWrite(writer);"
+    "        }"
+    "        callback(nativeio.error() || null);"
     "    };"
     "    runtime.deleteFile = function (path, callback) {"
     "        nativeio.unlink(path);"
@@ -50,22 +154,75 @@ QByteArray getRuntimeBindings() {
     "    runtime.currentDirectory = function () {"
     "        return nativeio.currentDirectory();"
     "    };"
+    // runtime.loadClass goes through runtime.loadClasses
+    "    if (nativeio.tracing()) {"
+    "        (function () {"
+    "            var loadClasses = runtime.loadClasses;"
+    "            runtime.loadClasses = function (classnames, callback) {"
+    "                var id = nativeio.beginSpan('loadClass '"
+    "                    + classnames.join(', '), 'js');"
+    "                try {"
+    "                    return loadClasses(classnames, callback);"
+    "                } finally {"
+    "                    nativeio.endSpan(id);"
+    "                }"
+    "            };"
+    "        }());"
+    "    }"
     "}";
+    return bindings;
+}
+/**
+ * Return the bindings for script mode, which also set the library paths,
+ * wrapped in a script element.
+ */
+const QByteArray& getScriptModeBindings() {
+    static const QByteArray bindings = "<script>//<![CDATA[\n"
+            + getRuntimeBindings() +
+            "if (typeof(runtime) !== 'undefined' && typeof(nativeio) !== 'undefined') {\n"
+            "    runtime.libraryPaths = function () {"
+            "        /* convert to javascript array */"
+            "        var p = nativeio.libraryPaths(),"
+            "            a = [], i;"
+            "        for (i in p) { a[i] = p[i]; }"
+            "        return a;"
+            "    };}//]]></script>";
+    return bindings;
 }
 
 PageRunner::PageRunner(const QStringList& args)
     : QWebPage(0),
       out(stdout),
       err(stderr),
-      view(new QWidget()) {
+      view(new QWidget()),
+      commandLine(args) {
 
-    QMap<QString, QString> settings = parseArguments(args);
-    QStringList arguments = args.mid(settings.size() * 2);
+    QStringList arguments;
+    QMap<QString, QString> settings = parseArguments(args, &arguments);
     exportpdf = settings.value("export-pdf");
     exportpng = settings.value("export-png");
+    pngPageHeight = settings.value("png-page-height").toInt();
+    thumbnailSize = parseSize(settings.value("export-thumbnail"));
+    parsePageRange(settings.value("pages"), fromPage, toPage);
+    shards = settings.value("shards", "1").toInt();
+    cache = 0;
+    if (settings.contains("cache-dir") && !settings.contains("daemon")
+            && !settings.contains("batch")) {
+        cache = new OutputCache(settings.value("cache-dir"),
+                settings.value("cache-size", "1024").toLongLong() << 20);
+    }
     url = QUrl(arguments[0]);
     nativeio = new NativeIO(this, QFileInfo(arguments[0]).dir(),
                             QDir::current());
+    nativeio->setThumbnailSize(exportpng.isEmpty() ? QSize() : thumbnailSize);
+    // queued, so the page is not exported from inside the calling script
+    connect(nativeio, SIGNAL(completed(int)), this, SLOT(scriptDone(int)),
+            Qt::QueuedConnection);
+    nativezip = new NativeZip(this, QDir::current());
+    if (settings.contains("compression-level")) {
+        nativezip->setCompressionLevel(
+                settings.value("compression-level").toInt());
+    }
     if (url.scheme() == "file" || url.isRelative()) {
         QFileInfo info(arguments[0]);
         url = QUrl::fromLocalFile(info.absoluteFilePath());
@@ -76,12 +233,49 @@ PageRunner::PageRunner(const QStringList& args)
         }
     }
     nam = new NAM(this, QUrl(url).host(), QUrl(url).port());
+    nam->setNativeZip(nativezip);
+    // file pages may load and read package entries
+    QWebSecurityOrigin::addLocalScheme("odfpkg");
+    if (settings.contains("asset-cache")) {
+        nam->setDiskCache(settings.value("asset-cache"));
+    }
+    nam->setMaxRequests(settings.value("max-requests").toInt());
 
     setNetworkAccessManager(nam);
     connect(this, SIGNAL(loadFinished(bool)), this, SLOT(finished(bool)));
     connect(mainFrame(), SIGNAL(javaScriptWindowObjectCleared()),
             this, SLOT(slotInitWindowObjects()));
     sawJSError = false;
+    settleTime = settings.value("settle-time", "150").toInt();
+    loaded = false;
+    doneCalled = false;
+    doneStatus = 0;
+    exiting = false;
+    persistent = settings.contains("daemon") || settings.contains("batch");
+    settleTimer.setSingleShot(true);
+    connect(&settleTimer, SIGNAL(timeout()), this, SLOT(reallyFinished()));
+    callsDone = false;
+    jobTimeout = settings.value("job-timeout", "60000").toInt();
+    timeoutTimer.setSingleShot(true);
+    connect(&timeoutTimer, SIGNAL(timeout()), this, SLOT(timedOut()));
+    idleTimer.setSingleShot(true);
+    idleTimer.setInterval(10);
+    connect(&idleTimer, SIGNAL(timeout()), this, SLOT(finishWhenIdle()));
+    runTimer.start();
+    phaseStart = Tracer::instance() ? Tracer::instance()->now() : 0;
+    jobStart = 0;
+    maxMemory = settings.value("max-memory").toLongLong() << 20;
+    overBudget = false;
+    memoryTimer.setInterval(100);
+    connect(&memoryTimer, SIGNAL(timeout()), this, SLOT(checkMemory()));
+    peakRss = MemoryUsage::rss();
+    if (peakRss >= 0) {
+        memoryTimer.start();
+    } else if (maxMemory > 0) {
+        err << "--max-memory is ignored, as the memory use of the process "
+               "cannot be read on this system." << endl;
+        maxMemory = 0;
+    }
 
     setView(view);
     scriptMode = arguments[0].endsWith(".js");
@@ -94,25 +288,16 @@ PageRunner::PageRunner(const QStringList& args)
         html = "<html>"
                 "<head><title></title>"
                 "<script>var arguments=[" + html + "];</script>"
-                "<script src=\"" + QUrl::fromLocalFile(arguments[0]).toEncoded() + "\"></script>";
+                "<script src=\"" + QUrl::fromLocalFile(
+                    QFileInfo(arguments[0]).absoluteFilePath()).toEncoded()
+                + "\"></script>";
         // add runtime modification
-        html += "<script>//<![CDATA[\n" + getRuntimeBindings() +
-             "if (typeof(runtime) !== 'undefined' && typeof(nativeio) !== 'undefined') {\n"
-             "    runtime.libraryPaths = function () {"
-             "        /* convert to javascript array */"
-             "        var p = nativeio.libraryPaths(),"
-             "            a = [], i;"
-             "        for (i in p) { a[i] = p[i]; }"
-             "        return a;"
-             "    };}//]]></script>";
+        html += getScriptModeBindings();
         html += "</head><body></body></html>\n";
-        QTemporaryFile tmp("XXXXXX.html");
-        tmp.setAutoRemove(true);
-        tmp.open();
-        tmp.write(html);
-        tmp.close();
-        QFileInfo info(tmp.fileName());
-        mainFrame()->load(QUrl::fromLocalFile(info.absoluteFilePath()));
+        // the shell is loaded from memory; relative urls resolve against the
+        // current directory, as they did when it was a file there
+        mainFrame()->setHtml(QString::fromUtf8(html),
+                             QUrl::fromLocalFile(QDir::currentPath() + "/"));
     } else {
         // Make the url absolute. If it is not done here, QWebFrame will do
         // it, and it will lose the query and fragment part.
@@ -132,6 +317,7 @@ QString PageRunner::userAgentForUrl ( const QUrl & url ) const
     return "Mozilla/5.0 (Windows NT 6.1; WOW64) AppleWebKit/535.2 (KHTML, like Gecko) Chrome/15.0.874.121 Safari/535.2";
 }
 PageRunner::~PageRunner() {
+    delete cache;
     delete view;
 }
 void PageRunner::finished(bool ok) {
@@ -139,7 +325,13 @@ void PageRunner::finished(bool ok) {
     if (!ok) {
         qApp->exit(1);
     }
+    if (loaded) {
+        // a later navigation inside the persistent page
+        return;
+    }
+    traceSpan("load", phaseStart);
     if (!scriptMode) {
+        TraceSpan span("bindings", "page");
         mainFrame()->evaluateJavaScript(getRuntimeBindings());
     }
 
@@ -152,55 +344,497 @@ void PageRunner::finished(bool ok) {
     connect(mainFrame(), SIGNAL(pageChanged()), this, SLOT(noteChange()));
     connect(this, SIGNAL(geometryChangeRequested(QRect)),
             this, SLOT(noteChange()));
-    QTimer::singleShot(150, this, SLOT(reallyFinished()));
+    loaded = true;
+    timings["load"] = runTimer.restart();
+    phaseStart = Tracer::instance() ? Tracer::instance()->now() : 0;
     changed = false;
     time.start();
+    if (doneCalled) {
+        // the page reported completion while it was still loading
+        finishWhenIdle();
+        return;
+    }
+    settleTimer.start(settleTime);
 }
 void PageRunner::reallyFinished() {
+    // fallback for pages that do not call nativeio.done(): wait until
+    // nothing changed during a full quiet period
     int latency = time.restart();
-    // err << latency << " " << changed << " " << nam->hasOutstandingRequests() << endl;
-    if (changed || latency >= 152 || nam->hasOutstandingRequests()) {
-        QTimer::singleShot(150, this, SLOT(reallyFinished()));
+    if (Tracer::instance()) {
+        QVariantMap args;
+        args["changed"] = changed;
+        traceSpan("settle", Tracer::instance()->now() - latency * 1000, args);
+    }
+    if (changed || latency >= settleTime + 2 || nam->hasOutstandingRequests()
+            || nativeio->hasPendingRequests()) {
+        settleTimer.start(settleTime);
         changed = false;
         return;
     }
-    if (!exportpdf.isEmpty() || !exportpng.isEmpty()) {
+    complete(sawJSError);
+}
+void PageRunner::scriptDone(int status) {
+    callsDone = true;
+    doneCalled = true;
+    doneStatus = status;
+    if (loaded) {
+        finishWhenIdle();
+    }
+}
+void PageRunner::finishWhenIdle() {
+    // the page may call done() before WebKit has fetched the images and
+    // fonts its style sheets refer to, so wait until nothing is in flight,
+    // for at most jobTimeout ms
+    if (exiting) {
+        return;
+    }
+    if (!timeoutTimer.isActive()) {
+        timeoutTimer.start(jobTimeout);
+    }
+    if (!nam->hasOutstandingRequests() && !nativeio->hasPendingRequests()) {
+        // a layout pass starts the requests of newly added style rules
+        mainFrame()->evaluateJavaScript(
+                "document.body && document.body.offsetHeight");
+        if (!nam->hasOutstandingRequests()) {
+            complete(doneStatus);
+            return;
+        }
+    }
+    idleTimer.start();
+}
+void PageRunner::runJob(const QVariantMap& job) {
+    QString format = job.value("format").toString();
+    QString output = job.value("output").toString();
+    if (format.isEmpty()) {
+        format = QFileInfo(output).suffix().toLower();
+    }
+    exportpdf = format == "pdf" ? output : QString();
+    exportpng = format == "png" ? output : QString();
+    thumbnailSize = parseSize(job.value("thumbnail").toString());
+    parsePageRange(job.value("pages").toString(), fromPage, toPage);
+    doneCalled = false;
+    exiting = false;
+    sawJSError = false;
+    changed = false;
+    timings.clear();
+    overBudget = false;
+    memory.clear();
+    peakRss = MemoryUsage::rss();
+    if (peakRss >= 0) {
+        memoryTimer.start();
+    }
+    runTimer.start();
+    jobStart = Tracer::instance() ? Tracer::instance()->now() : 0;
+    phaseStart = jobStart;
+    time.start();
+    nativeio->setThumbnailSize(exportpng.isEmpty() ? QSize() : thumbnailSize);
+    nativeio->startJob(job);
+    if (callsDone) {
+        timeoutTimer.start(jobTimeout);
+    } else {
+        settleTimer.start(settleTime);
+    }
+}
+void PageRunner::timedOut() {
+    err << "Job did not finish within " << jobTimeout << " ms." << endl;
+    complete(1);
+}
+bool PageRunner::checkMemory() {
+    if (overBudget || exiting) {
+        return overBudget;
+    }
+    const qint64 rss = MemoryUsage::rss();
+    peakRss = qMax(peakRss, rss);
+    if (maxMemory <= 0 || rss <= maxMemory) {
+        return false;
+    }
+    overBudget = true;
+    err << "Memory use of " << (rss >> 20) << " MB exceeds the budget of "
+        << (maxMemory >> 20) << " MB." << endl;
+    // this may be called from inside a script, so finish the run after the
+    // script has been stopped
+    QMetaObject::invokeMethod(this, "memoryExceeded", Qt::QueuedConnection);
+    return true;
+}
+void PageRunner::memoryExceeded() {
+    if (!overBudget) {
+        // a later job has started in the meantime
+        return;
+    }
+    // a page in this state is not exported
+    exportpdf.clear();
+    exportpng.clear();
+    complete(1);
+}
+void PageRunner::complete(int status) {
+    if (exiting) {
+        return;
+    }
+    exiting = true;
+    settleTimer.stop();
+    timeoutTimer.stop();
+    idleTimer.stop();
+    memoryTimer.stop();
+    timings["script"] = runTimer.restart();
+    traceSpan("script", phaseStart);
+    const bool thumbnail = !exportpng.isEmpty() && thumbnailSize.isValid();
+    if (!exportpdf.isEmpty() || (!exportpng.isEmpty() && !thumbnail)) {
         setViewportSize(mainFrame()->contentsSize());
     }
     if (!exportpng.isEmpty()) {
-        renderToFile(exportpng);
+        TraceSpan span("render", "page");
+        if (!(thumbnail ? renderThumbnail(exportpng)
+                : renderToFile(exportpng))) {
+            status = 1;
+        }
+        timings["render"] = runTimer.restart();
     }
     if (!exportpdf.isEmpty()) {
-        printToFile(exportpdf);
+        TraceSpan span("print", "page");
+        // shards print in child processes, which a daemon does not start
+        bool ok = shards > 1 && !persistent ? printSharded(exportpdf)
+                : printToFile(exportpdf, fromPage, toPage);
+        if (!ok) {
+            status = 1;
+        }
+        timings["print"] = runTimer.restart();
+    }
+    if (cache && status == 0) {
+        QStringList arguments;
+        QMap<QString, QString> settings
+                = parseArguments(commandLine, &arguments);
+        if (!exportpdf.isEmpty()) {
+            cache->store(cacheKey(settings, arguments, "pdf"), "pdf",
+                         exportpdf);
+        }
+        // split PNG exports are more than one file and are not cached
+        if (!exportpng.isEmpty() && pngPageHeight <= 0) {
+            cache->store(cacheKey(settings, arguments, "png"), "png",
+                         exportpng);
+        }
+    }
+    memory.clear();
+    const qint64 rss = MemoryUsage::rss();
+    if (rss >= 0) {
+        memory["rss"] = rss;
+        memory["peakRss"] = qMax(peakRss, rss);
+    }
+    if (overBudget) {
+        memory["exceeded"] = true;
+    } else {
+        // only engines that implement performance.memory report a JS heap
+        const QVariant heap = mainFrame()->evaluateJavaScript(
+                "window.performance && performance.memory"
+                " ? performance.memory.usedJSHeapSize : null");
+        if (!heap.isNull()) {
+            memory["jsHeap"] = heap;
+        }
+    }
+    if (persistent) {
+        // give back decoded images, style sheets and scripts before the
+        // next job, so more workers fit on one machine
+        QWebSettings::clearMemoryCaches();
+    }
+    if (persistent && loaded && jobStart) {
+        QVariantMap args;
+        args["status"] = status;
+        traceSpan("job", jobStart, args);
+    }
+    if (Tracer::instance()) {
+        // a daemon runs until it is stopped, so write the trace as it goes
+        Tracer::instance()->flush();
+    }
+    if (persistent) {
+        emit runFinished(status, timings);
+    } else {
+        qApp->exit(status);
     }
-    qApp->exit(sawJSError);
 }
-QMap<QString, QString> PageRunner::parseArguments(const QStringList& args) {
+void PageRunner::traceSpan(const QString& name, qint64 start,
+                           const QVariantMap& args) {
+    if (Tracer::instance()) {
+        Tracer::instance()->addSpan(name, "page", start, args);
+    }
+}
+QMap<QString, QString>
+PageRunner::parseArguments(const QStringList& args, QStringList* arguments) {
     int i = 0;
     QMap<QString, QString> settings;
-    while (i + 2 < args.length()) {
-        if (args[i].startsWith("--")) {
-            settings[args[i].mid(2)] = args[i+1];
+    while (i < args.length() && args[i].startsWith("--")) {
+        if (args[i] == "--") {
+            i += 1;
+            break;
+        }
+        int eq = args[i].indexOf('=');
+        if (eq != -1) {
+            settings[args[i].mid(2, eq - 2)] = args[i].mid(eq + 1);
+            i += 1;
+        } else {
+            settings[args[i].mid(2)] = args.value(i + 1);
+            i += 2;
         }
-        i += 2;
+    }
+    if (arguments) {
+        *arguments = args.mid(i);
     }
     return settings;
 }
 void PageRunner::slotInitWindowObjects() {
     mainFrame()->addToJavaScriptWindowObject("nativeio", nativeio);
+    mainFrame()->addToJavaScriptWindowObject("nativezip", nativezip);
+}
+bool PageRunner::renderToFile(const QString& filename) {
+    const QSize size = mainFrame()->contentsSize();
+    const int width = size.width();
+    if (pngPageHeight <= 0) {
+        return renderTiles(filename, 0, width, size.height());
+    }
+    // page n goes to name-n.png
+    const QFileInfo info(filename);
+    const QString base = info.path() + "/" + info.completeBaseName() + "-";
+    const QString suffix = info.suffix().isEmpty() ? QString()
+            : "." + info.suffix();
+    bool ok = true;
+    for (int top = 0, n = 1; top < size.height(); top += pngPageHeight, ++n) {
+        const int height = qMin(pngPageHeight, size.height() - top);
+        ok &= renderTiles(base + QString::number(n) + suffix, top, width,
+                          height);
+    }
+    return ok;
 }
-void PageRunner::renderToFile(const QString& filename) {
-    QImage pixmap(mainFrame()->contentsSize().boundedTo(QSize(10000,10000)),
-                  QImage::Format_ARGB32_Premultiplied);
-    QPainter painter(&pixmap);
-    mainFrame()->render(&painter, QWebFrame::ContentsLayer);
+bool PageRunner::renderTiles(const QString& filename, int top, int width,
+                             int height) {
+    // render a band of rows at a time and stream it into the encoder, so
+    // memory use does not grow with the size of the document; wide pages
+    // get lower bands
+    const int tileHeight = qBound(1, (16 << 20) / (4 * qMax(width, 1)), 256);
+    PngWriter png(filename, width, height);
+    QImage tile(width, qMin(tileHeight, qMax(height, 1)),
+                QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < height && png.error().isEmpty(); y += tileHeight) {
+        const int rows = qMin(tileHeight, height - y);
+        tile.fill(Qt::transparent);
+        QPainter painter(&tile);
+        painter.translate(0, -(top + y));
+        mainFrame()->render(&painter, QWebFrame::ContentsLayer,
+                            QRegion(0, top + y, width, rows));
+        painter.end();
+        png.addRows(tile, rows);
+    }
+    if (!png.finish()) {
+        err << "Cannot write '" << filename << "': " << png.error() << endl;
+        return false;
+    }
+    return true;
+}
+bool PageRunner::renderThumbnail(const QString& filename) {
+    // only the top of the page is painted, at full width and as high as the
+    // aspect ratio of the thumbnail allows, straight into the small image
+    const QSize size = mainFrame()->contentsSize();
+    const int width = qMax(1, size.width());
+    const int height = qMax(1, width * thumbnailSize.height()
+                                / thumbnailSize.width());
+    setViewportSize(QSize(width, height));
+    const double scale = double(thumbnailSize.width()) / width;
+    QImage image(thumbnailSize, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.scale(scale, scale);
+    mainFrame()->render(&painter, QWebFrame::ContentsLayer,
+                        QRegion(0, 0, width, height));
     painter.end();
-    pixmap.save(filename);
+    PngWriter png(filename, image.width(), image.height());
+    if (!png.addRows(image, image.height()) || !png.finish()) {
+        err << "Cannot write '" << filename << "': " << png.error() << endl;
+        return false;
+    }
+    return true;
 }
-void PageRunner::printToFile(const QString& filename) {
+bool PageRunner::printToFile(const QString& filename, int from, int to) {
     QPrinter printer(QPrinter::HighResolution);
     printer.setFontEmbeddingEnabled(true);
     printer.setOutputFormat(QPrinter::PdfFormat);
     printer.setOutputFileName(filename);
+    if (from > 0 || to > 0) {
+        // QWebFrame::print clamps the range to the pages there are
+        printer.setFromTo(qMax(1, from), to > 0 ? to : INT_MAX);
+    }
     mainFrame()->print(&printer);
+    return printer.printerState() != QPrinter::Error;
+}
+QByteArray PageRunner::cacheKey(const QMap<QString, QString>& settings,
+        const QStringList& arguments, const QString& format) {
+    const QString document = documentPath(arguments);
+    QStringList files;
+    files << arguments.value(0).section('#', 0, 0);
+    if (!document.isEmpty()) {
+        files << document;
+    }
+    files += arguments.mid(1);
+    QVariantMap options;
+    options["url"] = arguments.value(0);
+    options["pages"] = settings.value("pages");
+    options["png-page-height"] = settings.value("png-page-height");
+    options["export-thumbnail"] = settings.value("export-thumbnail");
+    return OutputCache::key(files, format, options);
+}
+QString PageRunner::documentPath(const QStringList& arguments) {
+    const QString page = arguments.value(0).section('#', 0, 0);
+    const QString fragment = arguments.value(0).section('#', 1);
+    if (fragment.isEmpty()) {
+        return QString();
+    }
+    return QFileInfo(page).dir().absoluteFilePath(fragment);
+}
+QSize PageRunner::parseSize(const QString& size) {
+    const int x = size.indexOf('x');
+    bool okWidth = false;
+    bool okHeight = false;
+    const QSize s(size.left(x).toInt(&okWidth),
+                  size.mid(x + 1).toInt(&okHeight));
+    return x != -1 && okWidth && okHeight && !s.isEmpty() ? s : QSize();
+}
+bool PageRunner::writeEmbeddedThumbnail(const QString& document,
+        const QSize& size, const QString& output) {
+    if (document.isEmpty() || !size.isValid()) {
+        return false;
+    }
+    ZipPackage package(document);
+    const ZipPackage::Entry* entry = package.isValid()
+            ? package.entry("Thumbnails/thumbnail.png") : 0;
+    QByteArray data;
+    QImage image;
+    if (!entry || !package.read(*entry, data)
+            || !image.loadFromData(data, "PNG")) {
+        return false;
+    }
+    // scaling up would give a blurred image, so render the page instead
+    if (image.width() < size.width() && image.height() < size.height()) {
+        return false;
+    }
+    image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+            .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    PngWriter png(output, image.width(), image.height());
+    return png.addRows(image, image.height()) && png.finish();
+}
+void PageRunner::parsePageRange(const QString& range, int& from, int& to) {
+    const int dash = range.indexOf('-');
+    from = range.left(dash).toInt();
+    to = dash == -1 ? from : range.mid(dash + 1).toInt();
+}
+int PageRunner::countPages() {
+    // QWebFrame::print does not tell the page count, so lay out the print
+    // and count the pages without painting them
+    PageCounter counter;
+    mainFrame()->print(&counter);
+    return counter.pages;
+}
+bool PageRunner::printSharded(const QString& filename) {
+    const int pages = countPages();
+    const int first = qMax(1, fromPage);
+    const int last = toPage > 0 ? qMin(toPage, pages) : pages;
+    if (first > last) {
+        // QWebFrame::print would write a blank page
+        err << "The page range is past the last page " << pages << "."
+            << endl;
+        return false;
+    }
+    // the first count % n shards get one page more than the others, so no
+    // shard is empty
+    const int count = last - first + 1;
+    const int n = qBound(1, shards, count);
+    QList<int> starts;
+    for (int k = 0; k <= n; ++k) {
+        starts.append(first + k * (count / n) + qMin(k, count % n));
+    }
+    for (int k = 0; k < n; ++k) {
+        if (starts[k] > starts[k + 1] - 1 || starts[k + 1] - 1 > last) {
+            err << "Cannot split pages " << first << "-" << last << " into "
+                << n << " shards." << endl;
+            return false;
+        }
+    }
+    if (n == 1) {
+        return printToFile(filename, fromPage, toPage);
+    }
+    // every shard but the first is printed by another qtjsruntime that
+    // loads the same page; the options are passed on except for the output
+    QStringList arguments;
+    QMap<QString, QString> settings = parseArguments(commandLine, &arguments);
+    settings.remove("export-png");
+    settings.remove("shards");
+    settings.remove("cache-dir");
+    // every shard writes a trace of its own next to the one of this process
+    const QString trace = settings.take("trace");
+    const QFileInfo traceInfo(trace);
+    const QFileInfo info(filename);
+    QStringList files;
+    QList<QProcess*> children;
+    for (int k = 0; k < n; ++k) {
+        const int from = starts[k];
+        const int to = starts[k + 1] - 1;
+        files.append(info.path() + "/" + info.completeBaseName() + "-shard"
+                     + QString::number(k + 1) + ".pdf");
+        QFile::remove(files[k]);
+        if (k == 0) {
+            continue;
+        }
+        settings["export-pdf"] = files[k];
+        if (!trace.isEmpty()) {
+            settings["trace"] = traceInfo.path() + "/"
+                    + traceInfo.completeBaseName() + "-shard"
+                    + QString::number(k + 1)
+                    + (traceInfo.suffix().isEmpty() ? QString()
+                       : "." + traceInfo.suffix());
+        }
+        settings["pages"] = QString::number(from) + "-" + QString::number(to);
+        QStringList childArgs;
+        QMap<QString, QString>::const_iterator i = settings.constBegin();
+        for (; i != settings.constEnd(); ++i) {
+            childArgs.append("--" + i.key() + "=" + i.value());
+        }
+        childArgs.append("--");
+        childArgs += arguments;
+        QProcess* child = new QProcess(this);
+        child->setProcessChannelMode(QProcess::ForwardedChannels);
+        child->start(QCoreApplication::applicationFilePath(), childArgs);
+        children.append(child);
+    }
+    QElapsedTimer elapsed;
+    elapsed.start();
+    bool ok = printToFile(files[0], starts[0], starts[1] - 1);
+    // the shards together get as long as one job
+    foreach (QProcess* child, children) {
+        const int left = qMax(0, int(jobTimeout - elapsed.elapsed()));
+        if (!child->waitForFinished(left)) {
+            err << "A PDF shard did not finish within " << jobTimeout
+                << " ms." << endl;
+            child->kill();
+            child->waitForFinished();
+            ok = false;
+        } else if (child->exitStatus() != QProcess::NormalExit
+                || child->exitCode() != 0) {
+            err << "A PDF shard could not be printed." << endl;
+            ok = false;
+        }
+        delete child;
+    }
+    PdfMerger merger;
+    foreach (const QString& file, files) {
+        if (ok && !merger.add(file)) {
+            ok = false;
+        }
+    }
+    if (ok && !merger.write(filename)) {
+        ok = false;
+    }
+    if (!merger.error().isEmpty()) {
+        err << merger.error() << endl;
+    }
+    foreach (const QString& file, files) {
+        QFile::remove(file);
+    }
+    return ok;
 }
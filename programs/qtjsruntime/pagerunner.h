@@ -1,12 +1,18 @@
 #ifndef PAGERUNNER_H
 #define PAGERUNNER_H
 
+#include <QElapsedTimer>
+#include <QSize>
 #include <QTextStream>
 #include <QTime>
+#include <QTimer>
+#include <QVariantMap>
 #include <QWebPage>
 
 class NAM;
 class NativeIO;
+class NativeZip;
+class OutputCache;
 
 class PageRunner : public QWebPage {
 Q_OBJECT
@@ -20,22 +26,131 @@ private:
     QTime time;
     bool scriptMode;
     NativeIO* nativeio;
+    NativeZip* nativezip;
     QString exportpdf;
     QString exportpng;
+    // if set, the PNG export is split into one image per this many pixels
+    int pngPageHeight;
+    // if valid, the PNG export is a thumbnail of the top of the page
+    QSize thumbnailSize;
+    // page range of the PDF export, 0 for the first or last page
+    int fromPage;
+    int toPage;
+    int shards;
+    const QStringList commandLine;
+    // exports of single runs are added to the cache, if there is one
+    OutputCache* cache;
     bool sawJSError;
+    // quiet period in ms after which a page that did not call
+    // nativeio.done() is considered finished
+    int settleTime;
+    bool loaded;
+    bool doneCalled;
+    int doneStatus;
+    bool exiting;
+    // in daemon mode the page stays open and runs one job after another
+    bool persistent;
+    QTimer settleTimer;
+    // set once the page has called nativeio.done(); jobs then wait for it,
+    // up to jobTimeout ms, instead of for the page to settle
+    bool callsDone;
+    int jobTimeout;
+    QTimer timeoutTimer;
+    // polls for the end of outstanding requests after nativeio.done()
+    QTimer idleTimer;
+    QElapsedTimer runTimer;
+    QVariantMap timings;
+    // start of the current phase and job in trace time, if tracing is on
+    qint64 phaseStart;
+    qint64 jobStart;
+    // the run fails if the process grows beyond this many bytes, 0 for no
+    // limit; memory is sampled every 100 ms and whenever WebKit asks
+    // whether a long script should be interrupted
+    qint64 maxMemory;
+    QTimer memoryTimer;
+    // highest sample of the resident set size during the current run
+    qint64 peakRss;
+    bool overBudget;
+    QVariantMap memory;
+    void traceSpan(const QString& name, qint64 start,
+                   const QVariantMap& args = QVariantMap());
 public:
     PageRunner(const QStringList& args);
     ~PageRunner();
+    /**
+     * Hand a job to the loaded page. The job is passed to the JavaScript
+     * handlers of nativeio.jobStarted and the page is exported to the
+     * job's output when the page calls nativeio.done() or has settled.
+     */
+    void runJob(const QVariantMap& job);
+    /**
+     * Split the command line into options and positional arguments.
+     * Options come first, as '--key value' or '--key=value'; '--' ends them.
+     */
+    static QMap<QString, QString> parseArguments(const QStringList& args,
+            QStringList* arguments = 0);
+    /**
+     * Parse a page range like '3-7', '3-' or '3'. Missing ends become 0.
+     */
+    static void parsePageRange(const QString& range, int& from, int& to);
+    /**
+     * Return the cache key for the output of a single run in the given
+     * format. It covers the page, a document named in its fragment, the
+     * script arguments and the options that change the output.
+     */
+    static QByteArray cacheKey(const QMap<QString, QString>& settings,
+            const QStringList& arguments, const QString& format);
+    /**
+     * Return the absolute path of the document named in the fragment of
+     * the page url, or an empty string if there is none.
+     */
+    static QString documentPath(const QStringList& arguments);
+    /**
+     * Parse a size like '200x280'. Returns an invalid size on errors.
+     */
+    static QSize parseSize(const QString& size);
+    /**
+     * Write the thumbnail that an ODF package carries to output, scaled to
+     * fit into size. Returns false if the document has no thumbnail or one
+     * that is smaller than size.
+     */
+    static bool writeEmbeddedThumbnail(const QString& document,
+            const QSize& size, const QString& output);
+    /**
+     * Return the memory use of the last run: the resident set size at its
+     * end and the highest one sampled during it, in bytes, and whether the
+     * run went over --max-memory. The sizes are those of the process, which
+     * all workers share, and are left out where the system does not report
+     * them.
+     */
+    QVariantMap memoryUsage() const {
+        return memory;
+    }
+    bool exceededMemory() const {
+        return overBudget;
+    }
+signals:
+    /**
+     * Emitted in daemon mode when the initial page load or a job is
+     * finished. timings has the duration of each phase in milliseconds.
+     */
+    void runFinished(int status, const QVariantMap& timings);
 private slots:
     void finished(bool ok);
     void noteChange() {
         changed = true;
     }
     void reallyFinished();
+    void scriptDone(int status);
+    void finishWhenIdle();
+    void timedOut();
+    bool checkMemory();
+    void memoryExceeded();
     void slotInitWindowObjects();
     bool shouldInterruptJavaScript() {
         changed = true;
-        return false;
+        // a script that exceeds the memory budget is stopped
+        return checkMemory();
     }
 private:
     void javaScriptConsoleMessage(const QString& message, int lineNumber,
@@ -56,11 +171,15 @@ private:
         changed = true;
         return false;
     }
-    void renderToFile(const QString& filename);
-    void printToFile(const QString& filename);
+    bool renderToFile(const QString& filename);
+    bool renderTiles(const QString& filename, int top, int width, int height);
+    bool renderThumbnail(const QString& filename);
+    bool printToFile(const QString& filename, int from, int to);
+    bool printSharded(const QString& filename);
+    int countPages();
+    void complete(int status);
     // overload because default impl was causing a crash
     QString userAgentForUrl(const QUrl&) const;
-    QMap<QString, QString> parseArguments(const QStringList& args);
 };
 
 #endif
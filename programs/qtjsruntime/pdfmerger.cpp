@@ -0,0 +1,404 @@
+#include "pdfmerger.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QVector>
+
+namespace {
+
+bool
+isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f'
+            || c == '\0';
+}
+bool
+isDelimiter(char c) {
+    return isSpace(c) || c == '(' || c == ')' || c == '<' || c == '>'
+            || c == '[' || c == ']' || c == '{' || c == '}' || c == '/'
+            || c == '%';
+}
+int
+skipSpace(const QByteArray& data, int i) {
+    while (i < data.size() && isSpace(data[i])) {
+        ++i;
+    }
+    return i;
+}
+bool
+readInt(const QByteArray& data, int& i, int& value) {
+    int j = i;
+    value = 0;
+    while (j < data.size() && data[j] >= '0' && data[j] <= '9') {
+        value = value * 10 + (data[j] - '0');
+        ++j;
+    }
+    if (j == i) {
+        return false;
+    }
+    i = j;
+    return true;
+}
+/**
+ * Read an indirect reference 'n g R' at i. On success i points behind it.
+ */
+bool
+readRef(const QByteArray& data, int& i, int& number) {
+    int j = i;
+    int generation;
+    if (!readInt(data, j, number)) {
+        return false;
+    }
+    j = skipSpace(data, j);
+    if (!readInt(data, j, generation)) {
+        return false;
+    }
+    j = skipSpace(data, j);
+    if (j >= data.size() || data[j] != 'R'
+            || (j + 1 < data.size() && !isDelimiter(data[j + 1]))) {
+        return false;
+    }
+    i = j + 1;
+    return true;
+}
+/**
+ * Return the position behind the dictionary key, e.g. '/Root', or -1.
+ */
+int
+findKey(const QByteArray& dict, const char* key) {
+    const int length = qstrlen(key);
+    int i = dict.indexOf(key);
+    while (i != -1) {
+        if (i + length >= dict.size() || isDelimiter(dict[i + length])) {
+            return i + length;
+        }
+        i = dict.indexOf(key, i + length);
+    }
+    return -1;
+}
+/**
+ * Return the object number that the key refers to, or -1.
+ */
+int
+refValue(const QByteArray& dict, const char* key) {
+    int i = findKey(dict, key);
+    int number;
+    if (i == -1) {
+        return -1;
+    }
+    i = skipSpace(dict, i);
+    return readRef(dict, i, number) ? number : -1;
+}
+/**
+ * Return the name that the key maps to, e.g. 'Pages' for '/Type /Pages'.
+ */
+QByteArray
+nameValue(const QByteArray& dict, const char* key) {
+    int i = findKey(dict, key);
+    if (i == -1) {
+        return QByteArray();
+    }
+    i = skipSpace(dict, i);
+    if (i >= dict.size() || dict[i] != '/') {
+        return QByteArray();
+    }
+    int j = i + 1;
+    while (j < dict.size() && !isDelimiter(dict[j])) {
+        ++j;
+    }
+    return dict.mid(i + 1, j - i - 1);
+}
+/**
+ * Add base to the numbers of all references in text.
+ */
+QByteArray
+renumber(const QByteArray& text, int base) {
+    QByteArray out;
+    out.reserve(text.size() + text.size() / 8);
+    int i = 0;
+    while (i < text.size()) {
+        const char c = text[i];
+        int number;
+        int j = i;
+        if (c >= '0' && c <= '9' && (i == 0 || isDelimiter(text[i - 1]))
+                && readRef(text, j, number)) {
+            out.append(QByteArray::number(number + base) + " 0 R");
+            i = j;
+        } else {
+            out.append(c);
+            ++i;
+        }
+    }
+    return out;
+}
+/**
+ * Point the /Parent entry of a page dictionary at parent.
+ */
+void
+replaceParent(QByteArray& dict, int parent) {
+    const int key = findKey(dict, "/Parent");
+    if (key == -1) {
+        return;
+    }
+    int i = skipSpace(dict, key);
+    int number;
+    if (readRef(dict, i, number)) {
+        dict.replace(key, i - key, " " + QByteArray::number(parent) + " 0 R");
+    }
+}
+QByteArray
+xrefEntry(qint64 offset, bool used) {
+    if (!used) {
+        return "0000000000 65535 f \n";
+    }
+    return QByteArray::number(offset).rightJustified(10, '0') + " 00000 n \n";
+}
+
+}
+
+PdfMerger::~PdfMerger() {
+    qDeleteAll(documents);
+}
+bool
+PdfMerger::add(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        errstr = "Cannot read '" + path + "'.";
+        return false;
+    }
+    Document* doc = new Document();
+    doc->data = file.readAll();
+    doc->base = 0;
+    if (!parse(doc)) {
+        errstr = "Cannot merge '" + path + "': " + errstr;
+        delete doc;
+        return false;
+    }
+    documents.append(doc);
+    return true;
+}
+bool
+PdfMerger::parse(Document* doc) {
+    const QByteArray& data = doc->data;
+    int i = data.lastIndexOf("startxref");
+    int xref;
+    if (i == -1) {
+        errstr = "no startxref.";
+        return false;
+    }
+    i = skipSpace(data, i + 9);
+    if (!readInt(data, i, xref) || data.mid(xref, 4) != "xref") {
+        // compressed cross-reference streams are not written by QPrinter
+        errstr = "unsupported cross-reference format.";
+        return false;
+    }
+    i = xref + 4;
+    for (;;) {
+        i = skipSpace(data, i);
+        if (data.mid(i, 7) == "trailer") {
+            break;
+        }
+        int first;
+        int count;
+        if (!readInt(data, i, first)) {
+            errstr = "broken cross-reference table.";
+            return false;
+        }
+        i = skipSpace(data, i);
+        if (!readInt(data, i, count)) {
+            errstr = "broken cross-reference table.";
+            return false;
+        }
+        for (int k = 0; k < count; ++k) {
+            int offset;
+            int generation;
+            i = skipSpace(data, i);
+            if (!readInt(data, i, offset)) {
+                errstr = "broken cross-reference table.";
+                return false;
+            }
+            i = skipSpace(data, i);
+            readInt(data, i, generation);
+            i = skipSpace(data, i);
+            if (i < data.size() && data[i] == 'n') {
+                doc->offsets[first + k] = offset;
+            }
+            ++i;
+        }
+    }
+    const int end = data.indexOf("startxref", i);
+    const QByteArray trailer = data.mid(i, end - i);
+    if (findKey(trailer, "/Prev") != -1) {
+        errstr = "incrementally updated files are not supported.";
+        return false;
+    }
+    const int root = refValue(trailer, "/Root");
+    const int info = refValue(trailer, "/Info");
+    const int pages = refValue(object(doc, root), "/Pages");
+    if (root == -1 || pages == -1) {
+        errstr = "no page tree.";
+        return false;
+    }
+    // the catalog, document info and page tree are replaced by new ones
+    doc->skipped.append(root);
+    doc->skipped.append(info);
+    return collectPages(doc, pages, 0);
+}
+bool
+PdfMerger::collectPages(Document* doc, int pagesObject, int depth) {
+    const QByteArray node = object(doc, pagesObject);
+    const QByteArray type = nameValue(node, "/Type");
+    if (type == "Page") {
+        doc->pages.append(pagesObject);
+        return true;
+    }
+    int i = findKey(node, "/Kids");
+    if (type != "Pages" || i == -1 || depth > 32) {
+        errstr = "broken page tree.";
+        return false;
+    }
+    doc->skipped.append(pagesObject);
+    i = node.indexOf('[', i);
+    const int end = node.indexOf(']', i);
+    if (i == -1 || end == -1) {
+        errstr = "broken page tree.";
+        return false;
+    }
+    ++i;
+    while (i < end) {
+        int kid;
+        i = skipSpace(node, i);
+        if (i >= end) {
+            break;
+        }
+        if (!readRef(node, i, kid) || !collectPages(doc, kid, depth + 1)) {
+            errstr = "broken page tree.";
+            return false;
+        }
+    }
+    return true;
+}
+/**
+ * Return the text between 'n g obj' and 'endobj', or an empty array.
+ */
+QByteArray
+PdfMerger::object(const Document* doc, int number) const {
+    const QByteArray& data = doc->data;
+    const int offset = doc->offsets.value(number, -1);
+    if (offset < 0) {
+        return QByteArray();
+    }
+    int start = data.indexOf("obj", offset);
+    if (start == -1) {
+        return QByteArray();
+    }
+    start += 3;
+    const int stream = data.indexOf("stream", start);
+    int end = data.indexOf("endobj", start);
+    if (stream != -1 && end != -1 && stream < end) {
+        // skip the stream data by its length, as it may contain anything
+        const QByteArray dict = data.mid(start, stream - start);
+        int i = findKey(dict, "/Length");
+        int length = -1;
+        int ref;
+        if (i != -1) {
+            i = skipSpace(dict, i);
+            int j = i;
+            if (readRef(dict, j, ref)) {
+                length = object(doc, ref).trimmed().toInt();
+            } else if (!readInt(dict, i, length)) {
+                length = -1;
+            }
+        }
+        const int dataStart = stream + 6;
+        const int dataEnd = length >= 0 ? dataStart + length
+                : data.indexOf("endstream", dataStart);
+        end = data.indexOf("endobj", data.indexOf("endstream", dataEnd));
+    }
+    if (end == -1) {
+        return QByteArray();
+    }
+    return data.mid(start, end - start);
+}
+int
+PdfMerger::pageCount() const {
+    int count = 0;
+    foreach (const Document* doc, documents) {
+        count += doc->pages.size();
+    }
+    return count;
+}
+bool
+PdfMerger::write(const QString& path) {
+    int next = 1;
+    foreach (Document* doc, documents) {
+        doc->base = next - 1;
+        if (!doc->offsets.isEmpty()) {
+            next += doc->offsets.lastKey();
+        }
+    }
+    const int pagesRoot = next;
+    const int catalog = next + 1;
+    QVector<qint64> offsets(catalog + 1, -1);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errstr = "Cannot write '" + path + "'.";
+        return false;
+    }
+    qint64 pos = 0;
+    QByteArray buffer = "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n";
+    QByteArray kids;
+    foreach (const Document* doc, documents) {
+        QMap<int, int>::const_iterator o = doc->offsets.constBegin();
+        for (; o != doc->offsets.constEnd(); ++o) {
+            const int number = o.key();
+            if (doc->skipped.contains(number)) {
+                continue;
+            }
+            const QByteArray body = object(doc, number);
+            // only the part before the stream data holds references
+            int split = body.indexOf("stream");
+            if (split == -1) {
+                split = body.size();
+            }
+            QByteArray head = renumber(body.left(split), doc->base);
+            if (doc->pages.contains(number)) {
+                replaceParent(head, pagesRoot);
+                kids += QByteArray::number(number + doc->base) + " 0 R\n";
+            }
+            offsets[number + doc->base] = pos + buffer.size();
+            buffer += QByteArray::number(number + doc->base) + " 0 obj";
+            buffer += head;
+            buffer += body.mid(split);
+            buffer += "endobj\n";
+            if (buffer.size() > (1 << 20)) {
+                if (file.write(buffer) != buffer.size()) {
+                    errstr = file.errorString();
+                    return false;
+                }
+                pos += buffer.size();
+                buffer.clear();
+            }
+        }
+    }
+    offsets[pagesRoot] = pos + buffer.size();
+    buffer += QByteArray::number(pagesRoot) + " 0 obj\n<<\n/Type /Pages\n"
+            "/Kids [\n" + kids + "]\n/Count "
+            + QByteArray::number(pageCount()) + "\n>>\nendobj\n";
+    offsets[catalog] = pos + buffer.size();
+    buffer += QByteArray::number(catalog) + " 0 obj\n<<\n/Type /Catalog\n"
+            "/Pages " + QByteArray::number(pagesRoot) + " 0 R\n>>\nendobj\n";
+    const qint64 xref = pos + buffer.size();
+    buffer += "xref\n0 " + QByteArray::number(offsets.size()) + "\n";
+    buffer += xrefEntry(0, false);
+    for (int n = 1; n < offsets.size(); ++n) {
+        buffer += xrefEntry(offsets[n], offsets[n] >= 0);
+    }
+    buffer += "trailer\n<<\n/Size " + QByteArray::number(offsets.size())
+            + "\n/Root " + QByteArray::number(catalog) + " 0 R\n>>\n"
+            "startxref\n" + QByteArray::number(xref) + "\n%%EOF\n";
+    if (file.write(buffer) != buffer.size() || !file.commit()) {
+        errstr = file.errorString();
+        return false;
+    }
+    return true;
+}
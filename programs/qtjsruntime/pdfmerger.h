@@ -0,0 +1,43 @@
+#ifndef PDFMERGER_H
+#define PDFMERGER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+
+// concatenates the pages of PDF files as written by QPrinter; the objects of
+// each file are copied with new numbers under one new page tree
+class PdfMerger {
+private:
+    struct Document {
+        QByteArray data;
+        // object number -> offset of 'n g obj'
+        QMap<int, int> offsets;
+        QList<int> pages;
+        QList<int> skipped;
+        int base;
+    };
+    QList<Document*> documents;
+    QString errstr;
+    bool parse(Document* doc);
+    bool collectPages(Document* doc, int pagesObject, int depth);
+    QByteArray object(const Document* doc, int number) const;
+public:
+    ~PdfMerger();
+    /**
+     * Add the file at path; its pages come after those added before.
+     */
+    bool add(const QString& path);
+    /**
+     * Write all pages to a new file at path.
+     */
+    bool write(const QString& path);
+    int pageCount() const;
+    QString error() const {
+        return errstr;
+    }
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "pngwriter.h"
+#include <QImage>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char signature[] = "\x89PNG\r\n\x1a\n";
+// IDAT chunks are written when this much compressed data is buffered
+const int chunkSize = 65536;
+
+void
+put32(QByteArray& out, quint32 v) {
+    uchar b[4];
+    qToBigEndian(v, b);
+    out.append(reinterpret_cast<const char*>(b), 4);
+}
+
+}
+
+PngWriter::PngWriter(const QString& path, int width_, int height_, int level)
+        :file(path), width(width_), height(height_), rows(0),
+         streamOpen(false) {
+    memset(&stream, 0, sizeof(stream));
+    if (width <= 0 || height <= 0) {
+        errstr = "Cannot write an empty image.";
+        return;
+    }
+    if (!file.open(QIODevice::WriteOnly)) {
+        errstr = file.errorString();
+        return;
+    }
+    if (deflateInit(&stream, level) != Z_OK) {
+        errstr = "Cannot initialize zlib.";
+        return;
+    }
+    streamOpen = true;
+    QByteArray header;
+    put32(header, width);
+    put32(header, height);
+    header.append(char(8));  // bit depth
+    header.append(char(6));  // color type: RGBA
+    header.append(char(0));  // compression: deflate
+    header.append(char(0));  // filter method
+    header.append(char(0));  // no interlacing
+    file.write(signature, 8);
+    writeChunk("IHDR", header);
+    line.resize(1 + 4 * width);
+    // Up filter: each byte is stored as the difference to the byte above
+    line[0] = char(2);
+    previous.fill(0, 4 * width);
+    current.resize(4 * width);
+}
+PngWriter::~PngWriter() {
+    if (streamOpen) {
+        deflateEnd(&stream);
+    }
+}
+bool
+PngWriter::writeChunk(const char* type, const QByteArray& data) {
+    QByteArray chunk;
+    chunk.reserve(data.length() + 12);
+    put32(chunk, data.length());
+    chunk.append(type, 4);
+    chunk.append(data);
+    const Bytef* crcData = reinterpret_cast<const Bytef*>(chunk.constData());
+    put32(chunk, crc32(crc32(0, Z_NULL, 0), crcData + 4, data.length() + 4));
+    if (file.write(chunk) != chunk.length()) {
+        errstr = file.errorString();
+        return false;
+    }
+    return true;
+}
+bool
+PngWriter::deflateData(const QByteArray& data, int flush) {
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+    stream.avail_in = data.length();
+    int result;
+    do {
+        const int offset = idat.length();
+        idat.resize(chunkSize);
+        stream.next_out = reinterpret_cast<Bytef*>(idat.data() + offset);
+        stream.avail_out = chunkSize - offset;
+        result = deflate(&stream, flush);
+        idat.resize(chunkSize - stream.avail_out);
+        if (result == Z_STREAM_ERROR) {
+            errstr = "Cannot compress image data.";
+            return false;
+        }
+        if (idat.length() == chunkSize
+                || (result == Z_STREAM_END && !idat.isEmpty())) {
+            if (!writeChunk("IDAT", idat)) {
+                return false;
+            }
+            idat.clear();
+        }
+    } while (stream.avail_in > 0 || stream.avail_out == 0
+             || (flush == Z_FINISH && result != Z_STREAM_END));
+    return true;
+}
+bool
+PngWriter::addRows(const QImage& image, int count) {
+    if (!streamOpen || !errstr.isEmpty()) {
+        return false;
+    }
+    count = qMin(count, height - rows);
+    uchar* out = reinterpret_cast<uchar*>(current.data());
+    const uchar* above = reinterpret_cast<const uchar*>(previous.constData());
+    for (int y = 0; y < count; ++y) {
+        const QRgb* in = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const QRgb p = in[x];
+            const int a = qAlpha(p);
+            uchar* o = out + 4 * x;
+            if (a == 255 || a == 0) {
+                o[0] = qRed(p);
+                o[1] = qGreen(p);
+                o[2] = qBlue(p);
+            } else {
+                // PNG stores straight, not premultiplied, alpha
+                o[0] = (qRed(p) * 255 + a / 2) / a;
+                o[1] = (qGreen(p) * 255 + a / 2) / a;
+                o[2] = (qBlue(p) * 255 + a / 2) / a;
+            }
+            o[3] = a;
+        }
+        char* filtered = line.data() + 1;
+        for (int i = 0; i < 4 * width; ++i) {
+            filtered[i] = char(out[i] - above[i]);
+        }
+        previous.swap(current);
+        out = reinterpret_cast<uchar*>(current.data());
+        above = reinterpret_cast<const uchar*>(previous.constData());
+        if (!deflateData(line, Z_NO_FLUSH)) {
+            return false;
+        }
+    }
+    rows += count;
+    return true;
+}
+bool
+PngWriter::finish() {
+    if (!streamOpen || !errstr.isEmpty()) {
+        return false;
+    }
+    if (rows != height) {
+        errstr = "Not all rows of the image were written.";
+        return false;
+    }
+    if (!deflateData(QByteArray(), Z_FINISH) || !writeChunk("IEND", QByteArray())) {
+        return false;
+    }
+    if (!file.commit()) {
+        errstr = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <QByteArray>
+#include <QSaveFile>
+#include <QString>
+#include <zlib.h>
+
+class QImage;
+
+// writes a PNG image row by row, so the whole image never has to be in
+// memory; the pixel data is deflated and written as it arrives
+class PngWriter {
+private:
+    QSaveFile file;
+    const int width;
+    const int height;
+    int rows;
+    z_stream stream;
+    bool streamOpen;
+    // filtered scanline and the unfiltered previous one for the Up filter
+    QByteArray line;
+    QByteArray previous;
+    QByteArray current;
+    QByteArray idat;
+    QString errstr;
+    bool writeChunk(const char* type, const QByteArray& data);
+    bool deflateData(const QByteArray& data, int flush);
+public:
+    /**
+     * Start writing an RGBA image of width x height pixels to path. The file
+     * only replaces path when finish() succeeds.
+     */
+    PngWriter(const QString& path, int width, int height,
+              int level = Z_DEFAULT_COMPRESSION);
+    ~PngWriter();
+    /**
+     * Append the first count rows of image, which must be in
+     * QImage::Format_ARGB32_Premultiplied and as wide as the PNG.
+     */
+    bool addRows(const QImage& image, int count);
+    /**
+     * Write the end of the image. All rows must have been added.
+     */
+    bool finish();
+    QString error() const {
+        return errstr;
+    }
+};
+
+#endif
@@ -3,18 +3,88 @@
  * If the URI ends in .js it will be run in QtScript engine, otherwise, it will
  * be assumed to be a webpage that will be opened in
  */
+#include "daemon.h"
+#include "outputcache.h"
 #include "pagerunner.h"
+#include "tracer.h"
 #include <QApplication>
+#include <QScopedPointer>
 int
 main(int argc, char** argv) {
-    if (argc < 2) {
-        QTextStream err(stderr);
+    QStringList args;
+    for (int i = 1; i < argc; ++i) {
+        args.append(QString::fromLocal8Bit(argv[i]));
+    }
+    QStringList arguments;
+    QMap<QString, QString> settings
+            = PageRunner::parseArguments(args, &arguments);
+    QTextStream err(stderr);
+    bool valid = !arguments.isEmpty();
+    if (settings.contains("compression-level")) {
+        bool ok = false;
+        const int level = settings.value("compression-level").toInt(&ok);
+        if (!ok || level < -1 || level > 9) {
+            err << "--compression-level must be a number from 0 to 9, "
+                   "or -1 for the default.\n";
+            valid = false;
+        }
+    }
+    if (!valid) {
         err << "Usage: " << argv[0] << " [--export-pdf pdffile] "
-               "[--export-png pngfile] html/javascripfile [arguments]\n";
+               "[--pages from-to] [--shards n] "
+               "[--export-png pngfile] [--png-page-height px] "
+               "[--export-thumbnail WxH] "
+               "[--compression-level 0-9] "
+               "[--settle-time ms] [--daemon -|socketname] "
+               "[--batch manifest] [--summary summaryfile] "
+               "[--job-timeout ms] [--workers n] [--queue-size n] "
+               "[--recycle-after n] [--cache-dir dir] [--cache-size MB] "
+               "[--trace tracefile] [--max-memory MB] [--asset-cache dir] "
+               "[--max-requests n] "
+               "html/javascripfile [arguments]\n";
         return 1;
     }
+    // written when main returns
+    QScopedPointer<Tracer> tracer;
+    if (settings.contains("trace")) {
+        tracer.reset(new Tracer(settings.value("trace")));
+    }
+    const bool persistent = settings.contains("daemon")
+            || settings.contains("batch");
+    const QString pdf = settings.value("export-pdf");
+    const QString png = settings.value("export-png");
+    if (!persistent && pdf.isEmpty() && !png.isEmpty()
+            && PageRunner::writeEmbeddedThumbnail(
+                    PageRunner::documentPath(arguments),
+                    PageRunner::parseSize(settings.value("export-thumbnail")),
+                    png)) {
+        // the package has a thumbnail that is good enough
+        return 0;
+    }
+    if (settings.contains("cache-dir") && !persistent
+            && (!pdf.isEmpty() || !png.isEmpty())
+            && !settings.contains("png-page-height")) {
+        // serve the exports from the cache without starting WebKit
+        OutputCache cache(settings.value("cache-dir"),
+                settings.value("cache-size", "1024").toLongLong() << 20);
+        bool hit = pdf.isEmpty() || cache.fetch(PageRunner::cacheKey(
+                settings, arguments, "pdf"), "pdf", pdf);
+        hit = hit && (png.isEmpty() || cache.fetch(PageRunner::cacheKey(
+                settings, arguments, "png"), "png", png));
+        if (hit) {
+            return 0;
+        }
+    }
     QApplication app(argc, argv);
     app.setApplicationName(argv[0]);
-    PageRunner p(QCoreApplication::arguments().mid(1));
+    args = QCoreApplication::arguments().mid(1);
+    if (tracer) {
+        tracer->addSpan("start", "process", 0);
+    }
+    if (persistent) {
+        Daemon daemon(args);
+        return app.exec();
+    }
+    PageRunner p(args);
     return app.exec();
 }
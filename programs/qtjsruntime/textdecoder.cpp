@@ -0,0 +1,92 @@
+#include "textdecoder.h"
+#include <QMutexLocker>
+#include <QTextCodec>
+#include <cstring>
+
+namespace {
+
+bool
+isAscii(const QByteArray& data) {
+    const char* p = data.constData();
+    const int n = data.length();
+    int i = 0;
+    // test eight bytes at a time for a set high bit
+    for (; i + 8 <= n; i += 8) {
+        quint64 word;
+        memcpy(&word, p + i, 8);
+        if (word & Q_UINT64_C(0x8080808080808080)) {
+            return false;
+        }
+    }
+    for (; i < n; ++i) {
+        if (p[i] & 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+isAsciiCompatible(const QString& encoding) {
+    const QString e = encoding.toLower();
+    return e == "utf-8" || e == "utf8" || e == "ascii" || e == "us-ascii"
+            || e == "iso-8859-1" || e == "latin1";
+}
+
+}
+
+TextDecoder::TextDecoder() :calls(0), bytes(0), asciiCalls(0), codecCalls(0),
+        latin1Calls(0), invalidChars(0), codecLookups(0) {
+}
+QTextCodec*
+TextDecoder::codec(const QString& encoding) {
+    QHash<QString, QTextCodec*>::const_iterator i = codecs.find(encoding);
+    if (i != codecs.end()) {
+        return i.value();
+    }
+    // unknown encodings are cached too, as 0
+    QTextCodec* c = QTextCodec::codecForName(encoding.toLatin1());
+    codecs.insert(encoding, c);
+    codecLookups += 1;
+    return c;
+}
+QString
+TextDecoder::decode(const QByteArray& data, const QString& encoding) {
+    QMutexLocker locker(&mutex);
+    calls += 1;
+    bytes += data.length();
+    if (encoding != "binary") {
+        if (isAsciiCompatible(encoding) && isAscii(data)) {
+            asciiCalls += 1;
+            return QString::fromLatin1(data);
+        }
+        QTextCodec* c = codec(encoding);
+        if (c) {
+            locker.unlock();
+            QTextCodec::ConverterState state;
+            const QString out = c->toUnicode(data.constData(), data.length(),
+                                             &state);
+            locker.relock();
+            invalidChars += state.invalidChars;
+            if (out.length() > 0 || data.length() == 0) {
+                codecCalls += 1;
+                return out;
+            }
+        }
+    }
+    latin1Calls += 1;
+    return QString::fromLatin1(data);
+}
+QVariantMap
+TextDecoder::statistics() const {
+    QMutexLocker locker(&mutex);
+    QVariantMap m;
+    m.insert("calls", calls);
+    m.insert("bytes", bytes);
+    m.insert("ascii", asciiCalls);
+    m.insert("codec", codecCalls);
+    m.insert("latin1", latin1Calls);
+    m.insert("invalidChars", invalidChars);
+    m.insert("codecLookups", codecLookups);
+    return m;
+}
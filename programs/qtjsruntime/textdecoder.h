@@ -0,0 +1,40 @@
+#ifndef TEXTDECODER_H
+#define TEXTDECODER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVariantMap>
+
+class QTextCodec;
+
+// decodes file contents to strings; resolved codecs are cached and pure
+// ascii input skips the codec entirely
+class TextDecoder {
+private:
+    mutable QMutex mutex;
+    QHash<QString, QTextCodec*> codecs;
+    qint64 calls;
+    qint64 bytes;
+    qint64 asciiCalls;
+    qint64 codecCalls;
+    qint64 latin1Calls;
+    qint64 invalidChars;
+    int codecLookups;
+    QTextCodec* codec(const QString& encoding);
+public:
+    TextDecoder();
+    /**
+     * Decode data with the given encoding. If there is no codec for the
+     * encoding or it yields nothing, each byte becomes one character.
+     * Safe to call from several threads.
+     */
+    QString decode(const QByteArray& data, const QString& encoding);
+    /**
+     * Counters of the decoding paths taken so far.
+     */
+    QVariantMap statistics() const;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+
+namespace {
+
+// events are written once this many have been collected
+const int batchSize = 256;
+
+}
+
+Tracer* Tracer::tracer = 0;
+
+Tracer::Tracer(const QString& path) :file(path), failed(false), first(true) {
+    clock.start();
+    tracer = this;
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || file.write("[\n") != 2) {
+        QTextStream err(stderr);
+        err << "Cannot write trace '" << path << "'.\n";
+        failed = true;
+    }
+    QVariantMap name;
+    name["name"] = QString("qtjsruntime");
+    QVariantMap event;
+    event["name"] = QString("process_name");
+    event["ph"] = QString("M");
+    event["pid"] = QCoreApplication::applicationPid();
+    event["args"] = name;
+    events.append(event);
+}
+Tracer::~Tracer() {
+    addSpan("process", "process", 0);
+    tracer = 0;
+    QMutexLocker locker(&mutex);
+    write();
+    if (!failed) {
+        file.write("\n]\n");
+    }
+}
+void
+Tracer::flush() {
+    QMutexLocker locker(&mutex);
+    write();
+}
+void
+Tracer::write() {
+    // called with the mutex held
+    QByteArray json;
+    foreach (const QVariant& event, events) {
+        if (!first) {
+            json += ",\n";
+        }
+        first = false;
+        json += QJsonDocument(QJsonObject::fromVariantMap(event.toMap()))
+                .toJson(QJsonDocument::Compact);
+    }
+    events.clear();
+    if (failed || json.isEmpty()) {
+        return;
+    }
+    if (file.write(json) != json.size() || !file.flush()) {
+        QTextStream err(stderr);
+        err << "Cannot write trace '" << file.fileName() << "'.\n";
+        failed = true;
+    }
+}
+void
+Tracer::addSpan(const QString& name, const QString& category, qint64 start,
+                const QVariantMap& args) {
+    const qint64 end = now();
+    QVariantMap event;
+    event["name"] = name;
+    event["cat"] = category;
+    // complete events carry their duration, so no end event is needed
+    event["ph"] = QString("X");
+    event["ts"] = start;
+    event["dur"] = end - start;
+    event["pid"] = QCoreApplication::applicationPid();
+    event["tid"] = quint64(quintptr(QThread::currentThreadId()));
+    if (!args.isEmpty()) {
+        event["args"] = args;
+    }
+    QMutexLocker locker(&mutex);
+    events.append(event);
+    if (events.size() >= batchSize) {
+        write();
+    }
+}
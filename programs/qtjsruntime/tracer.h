@@ -0,0 +1,73 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVariantList>
+#include <QVariantMap>
+
+// writes spans in the Trace Event Format that chrome://tracing and
+// Perfetto read; a process has at most one tracer. Events are written in
+// batches as a JSON array, which the format allows to be unterminated, so
+// the trace of a process that is killed can still be read.
+class Tracer {
+private:
+    static Tracer* tracer;
+    QFile file;
+    bool failed;
+    bool first;
+    QElapsedTimer clock;
+    QMutex mutex;
+    QVariantList events;
+    void write();
+public:
+    Tracer(const QString& path);
+    ~Tracer();
+    /**
+     * Return the tracer of the process, or 0 if tracing is off.
+     */
+    static Tracer* instance() {
+        return tracer;
+    }
+    /**
+     * Return the microseconds since the tracer was created.
+     */
+    qint64 now() const {
+        return clock.nsecsElapsed() / 1000;
+    }
+    /**
+     * Add a span from start, as returned by now(), until now.
+     * Safe to call from several threads.
+     */
+    void addSpan(const QString& name, const QString& category, qint64 start,
+                 const QVariantMap& args = QVariantMap());
+    /**
+     * Write the events collected so far to the file, e.g. after a job.
+     */
+    void flush();
+};
+
+// a span from construction to destruction; does nothing if tracing is off
+class TraceSpan {
+private:
+    const QString name;
+    const char* const category;
+    const qint64 start;
+    QVariantMap args;
+public:
+    TraceSpan(const QString& name_, const char* category_)
+        :name(name_), category(category_),
+         start(Tracer::instance() ? Tracer::instance()->now() : 0) {}
+    ~TraceSpan() {
+        if (Tracer::instance()) {
+            Tracer::instance()->addSpan(name, category, start, args);
+        }
+    }
+    void setArg(const QString& key, const QVariant& value) {
+        args[key] = value;
+    }
+};
+
+#endif
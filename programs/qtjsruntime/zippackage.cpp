@@ -0,0 +1,205 @@
+#include "zippackage.h"
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <climits>
+#include <cstring>
+#include <zlib.h>
+
+namespace {
+
+const quint32 localHeaderSignature = 0x04034b50;
+const quint32 centralHeaderSignature = 0x02014b50;
+const quint32 endOfCentralDirectorySignature = 0x06054b50;
+const int localHeaderSize = 30;
+const int centralHeaderSize = 46;
+const int endOfCentralDirectorySize = 22;
+// deflate cannot compress better than about 1032:1, so a larger declared
+// size is not the size of the data
+const qint64 maxDeflateRatio = 1032;
+
+quint16
+u16(const QByteArray& data, int pos) {
+    return qFromLittleEndian<quint16>(
+            reinterpret_cast<const uchar*>(data.constData() + pos));
+}
+quint32
+u32(const QByteArray& data, int pos) {
+    return qFromLittleEndian<quint32>(
+            reinterpret_cast<const uchar*>(data.constData() + pos));
+}
+
+}
+
+QDateTime
+ZipPackage::Entry::date() const {
+    const QDateTime date(QDate(1980 + (dosDate >> 9), (dosDate >> 5) & 0xf,
+                               dosDate & 0x1f),
+                         QTime(dosTime >> 11, (dosTime >> 5) & 0x3f,
+                               (dosTime & 0x1f) * 2));
+    // zip writers that do not set a time leave 0, which is no valid date;
+    // the earliest date that can be stored stands in for it
+    return date.isValid() ? date : QDateTime(QDate(1980, 1, 1), QTime(0, 0));
+}
+
+ZipPackage::ZipPackage(const QString& path) :file(path), map(0),
+        fileSize_(0) {
+    if (!file.open(QIODevice::ReadOnly)) {
+        errstr = "Could not open " + path + ".";
+        return;
+    }
+    fileSize_ = file.size();
+    lastModified_ = QFileInfo(file).lastModified();
+    if (fileSize_ > 0) {
+        map = file.map(0, fileSize_);
+    }
+    readCentralDirectory();
+}
+ZipPackage::~ZipPackage() {
+    if (map) {
+        file.unmap(map);
+    }
+}
+bool
+ZipPackage::readBytes(qint64 offset, qint64 length, QByteArray& data) {
+    if (offset < 0 || length < 0 || offset + length > fileSize_) {
+        return false;
+    }
+    if (map) {
+        data = QByteArray(reinterpret_cast<const char*>(map + offset), length);
+        return true;
+    }
+    QMutexLocker locker(&mutex);
+    if (!file.seek(offset)) {
+        return false;
+    }
+    data = file.read(length);
+    return data.length() == length;
+}
+bool
+ZipPackage::readCentralDirectory() {
+    QByteArray tail;
+    qint64 tailSize = qMin(fileSize_,
+            Q_INT64_C(65535) + endOfCentralDirectorySize);
+    if (!readBytes(fileSize_ - tailSize, tailSize, tail)) {
+        errstr = "Could not read end of central directory.";
+        return false;
+    }
+    int eocd = tail.length() - endOfCentralDirectorySize;
+    while (eocd >= 0 && u32(tail, eocd) != endOfCentralDirectorySignature) {
+        --eocd;
+    }
+    if (eocd < 0) {
+        errstr = "File is not a zip file.";
+        return false;
+    }
+    const int count = u16(tail, eocd + 10);
+    const qint64 cdSize = u32(tail, eocd + 12);
+    const qint64 cdOffset = u32(tail, eocd + 16);
+    QByteArray cd;
+    if (!readBytes(cdOffset, cdSize, cd)) {
+        errstr = "Could not read central directory.";
+        return false;
+    }
+    int pos = 0;
+    for (int i = 0; i < count; ++i) {
+        if (pos + centralHeaderSize > cd.length()
+                || u32(cd, pos) != centralHeaderSignature) {
+            errstr = "Corrupt central directory.";
+            return false;
+        }
+        Entry e;
+        e.flags = u16(cd, pos + 8);
+        e.method = u16(cd, pos + 10);
+        e.dosTime = u16(cd, pos + 12);
+        e.dosDate = u16(cd, pos + 14);
+        e.crc = u32(cd, pos + 16);
+        e.compressedSize = u32(cd, pos + 20);
+        e.size = u32(cd, pos + 24);
+        const int nameLength = u16(cd, pos + 28);
+        const int extraLength = u16(cd, pos + 30);
+        const int commentLength = u16(cd, pos + 32);
+        e.headerOffset = u32(cd, pos + 42);
+        if (pos + centralHeaderSize + nameLength > cd.length()) {
+            errstr = "Corrupt central directory.";
+            return false;
+        }
+        const QByteArray name = cd.mid(pos + centralHeaderSize, nameLength);
+        // bit 11 marks utf8 names
+        e.name = (e.flags & 0x800) ? QString::fromUtf8(name)
+                                   : QString::fromLatin1(name);
+        index.insert(e.name, entryList.length());
+        entryList.append(e);
+        pos += centralHeaderSize + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+const ZipPackage::Entry*
+ZipPackage::entry(const QString& name) const {
+    QHash<QString, int>::const_iterator i = index.find(name);
+    if (i == index.end()) {
+        return 0;
+    }
+    return &entryList.at(i.value());
+}
+bool
+ZipPackage::readRaw(const Entry& entry, QByteArray& data) {
+    QByteArray header;
+    if (!readBytes(entry.headerOffset, localHeaderSize, header)
+            || u32(header, 0) != localHeaderSignature) {
+        return false;
+    }
+    const qint64 offset = entry.headerOffset + localHeaderSize
+            + u16(header, 26) + u16(header, 28);
+    return readBytes(offset, entry.compressedSize, data);
+}
+bool
+ZipPackage::read(const Entry& entry, QByteArray& data) {
+    QByteArray raw;
+    if (!readRaw(entry, raw)) {
+        return false;
+    }
+    if (entry.method == 0) {
+        data = raw;
+    } else if (entry.method != Z_DEFLATED
+            || !inflateRaw(raw, entry.size, data)) {
+        return false;
+    }
+    const quint32 crc = crc32(crc32(0, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(data.constData()), data.length());
+    if (data.length() != entry.size || crc != entry.crc) {
+        data.clear();
+        return false;
+    }
+    return true;
+}
+bool
+ZipPackage::inflateRaw(const QByteArray& in, qint64 size, QByteArray& out) {
+    // the size comes from the package, so do not allocate whatever it says
+    if (size < 0 || size > INT_MAX
+            || size > (in.length() + 1) * maxDeflateRatio) {
+        out.clear();
+        return false;
+    }
+    out.resize(size);
+    if (size == 0) {
+        return true;
+    }
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // negative window bits: raw deflate data without zlib header
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.constData()));
+    stream.avail_in = in.length();
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = size;
+    const int result = inflate(&stream, Z_FINISH);
+    const bool ok = result == Z_STREAM_END && stream.total_out == static_cast<uLong>(size);
+    inflateEnd(&stream);
+    if (!ok) {
+        out.clear();
+    }
+    return ok;
+}
@@ -0,0 +1,87 @@
+#ifndef ZIPPACKAGE_H
+#define ZIPPACKAGE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+// index of the central directory of a zip file; entries are read and
+// inflated on demand
+class ZipPackage {
+public:
+    struct Entry {
+        QString name;
+        quint16 flags;
+        quint16 method;
+        quint16 dosTime;
+        quint16 dosDate;
+        quint32 crc;
+        qint64 compressedSize;
+        qint64 size;
+        qint64 headerOffset;
+        QDateTime date() const;
+        bool isCompressed() const {
+            return method != 0;
+        }
+    };
+private:
+    QFile file;
+    uchar* map;
+    QMutex mutex;
+    qint64 fileSize_;
+    QDateTime lastModified_;
+    QList<Entry> entryList;
+    QHash<QString, int> index;
+    QString errstr;
+    bool readCentralDirectory();
+    bool readBytes(qint64 offset, qint64 length, QByteArray& data);
+public:
+    ZipPackage(const QString& path);
+    ~ZipPackage();
+    bool isValid() const {
+        return errstr.isNull();
+    }
+    QString error() const {
+        return errstr;
+    }
+    QString path() const {
+        return file.fileName();
+    }
+    qint64 fileSize() const {
+        return fileSize_;
+    }
+    QDateTime lastModified() const {
+        return lastModified_;
+    }
+    /**
+     * Entries in the order of the central directory.
+     */
+    const QList<Entry>& entries() const {
+        return entryList;
+    }
+    /**
+     * Return the entry with the given name or 0 if there is none.
+     */
+    const Entry* entry(const QString& name) const;
+    /**
+     * Read and inflate an entry. Returns false if the entry cannot be read
+     * or does not match its size and crc. Safe to call from several threads.
+     */
+    bool read(const Entry& entry, QByteArray& data);
+    /**
+     * Read the bytes of an entry as they are stored in the package.
+     * Safe to call from several threads.
+     */
+    bool readRaw(const Entry& entry, QByteArray& data);
+    /**
+     * Inflate a raw deflate stream of known uncompressed size. Sizes over
+     * 2 GB or beyond what deflate can reach from the input are refused.
+     */
+    static bool inflateRaw(const QByteArray& in, qint64 size, QByteArray& out);
+};
+
+#endif
@@ -0,0 +1,251 @@
+#include "zipwriter.h"
+#include <QRunnable>
+#include <QSemaphore>
+#include <QtEndian>
+#include <cstring>
+#include <zlib.h>
+
+struct ZipWriter::Item {
+    QString name;
+    QDateTime date;
+    quint16 method;
+    QByteArray data;
+    quint32 crc;
+    qint64 size;
+    QSemaphore done;
+    bool ok;
+};
+
+namespace {
+
+const quint32 localHeaderSignature = 0x04034b50;
+const quint32 centralHeaderSignature = 0x02014b50;
+const quint32 endOfCentralDirectorySignature = 0x06054b50;
+// without ZIP64 extensions, counts are 16 and sizes and offsets 32 bits
+const int maxEntries = 0xffff;
+const qint64 maxOffset = 0xffffffffLL;
+
+void
+put16(QByteArray& out, quint16 v) {
+    uchar b[2];
+    qToLittleEndian(v, b);
+    out.append(reinterpret_cast<const char*>(b), 2);
+}
+void
+put32(QByteArray& out, quint32 v) {
+    uchar b[4];
+    qToLittleEndian(v, b);
+    out.append(reinterpret_cast<const char*>(b), 4);
+}
+quint16
+dosTime(const QDateTime& date) {
+    if (!date.isValid()) {
+        return 0;
+    }
+    const QTime t = date.time();
+    return (t.hour() << 11) | (t.minute() << 5) | (t.second() / 2);
+}
+quint16
+dosDate(const QDateTime& date) {
+    const QDate d = date.date();
+    if (!date.isValid() || d.year() < 1980) {
+        return (1 << 5) | 1;
+    }
+    return ((d.year() - 1980) << 9) | (d.month() << 5) | d.day();
+}
+
+bool
+deflateRaw(const QByteArray& in, int level, QByteArray& out) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // negative window bits: raw deflate data without zlib header
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&stream, in.length()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.constData()));
+    stream.avail_in = in.length();
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = out.length();
+    const int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+// computes crc and compresses one entry on the thread pool
+class CompressTask : public QRunnable {
+private:
+    ZipWriter::Item* const item;
+    const int level;
+public:
+    CompressTask(ZipWriter::Item* item_, int level_)
+        :item(item_), level(level_) {
+    }
+    void run() {
+        const QByteArray& in = item->data;
+        item->size = in.length();
+        item->crc = crc32(crc32(0, Z_NULL, 0),
+                reinterpret_cast<const Bytef*>(in.constData()), in.length());
+        item->ok = true;
+        if (item->method == Z_DEFLATED) {
+            QByteArray out;
+            item->ok = deflateRaw(in, level, out);
+            item->data = out;
+        }
+        item->done.release();
+    }
+};
+
+}
+
+ZipWriter::ZipWriter(const QString& path, int level_)
+    :file(path), level(level_) {
+    if (!file.open(QIODevice::WriteOnly)) {
+        errstr = "Could not open " + path + " for writing.";
+    }
+}
+ZipWriter::~ZipWriter() {
+    pool.waitForDone();
+    qDeleteAll(items);
+}
+void
+ZipWriter::add(const QString& name, const QByteArray& data, bool compress,
+               const QDateTime& date) {
+    Item* item = new Item();
+    item->name = name;
+    item->date = date;
+    item->data = data;
+    item->crc = 0;
+    item->size = 0;
+    item->ok = false;
+    item->method = compress && name != "mimetype" ? Z_DEFLATED : 0;
+    queue(item);
+    pool.start(new CompressTask(item, level));
+}
+void
+ZipWriter::addRaw(const QString& name, const QByteArray& data,
+                  quint16 method, quint32 crc, qint64 size,
+                  const QDateTime& date) {
+    Item* item = new Item();
+    item->name = name;
+    item->date = date;
+    item->data = data;
+    item->crc = crc;
+    item->size = size;
+    item->ok = true;
+    item->method = method;
+    queue(item);
+    item->done.release();
+}
+void
+ZipWriter::queue(Item* item) {
+    if (item->name == "mimetype") {
+        items.prepend(item);
+    } else {
+        items.append(item);
+    }
+}
+bool
+ZipWriter::writeItem(Item* item, QByteArray& centralDirectory) {
+    item->done.acquire();
+    if (!item->ok) {
+        errstr = "Could not compress " + item->name + ".";
+        return false;
+    }
+    const QByteArray name = item->name.toUtf8();
+    if (name.length() > 0xffff) {
+        errstr = "The name of " + item->name + " is too long.";
+        return false;
+    }
+    if (file.pos() + 30 + name.length() + item->data.length() > maxOffset
+            || item->size > maxOffset) {
+        errstr = "Cannot write " + item->name
+                + ": zip files over 4 GB are not supported.";
+        return false;
+    }
+    // bit 11: name is utf8
+    const quint16 flags = name.length() != item->name.length() ? 0x800 : 0;
+    const quint16 method = item->method;
+    const quint32 offset = file.pos();
+    QByteArray header;
+    put32(header, localHeaderSignature);
+    put16(header, 20); // version needed to extract
+    put16(header, flags);
+    put16(header, method);
+    put16(header, dosTime(item->date));
+    put16(header, dosDate(item->date));
+    put32(header, item->crc);
+    put32(header, item->data.length());
+    put32(header, item->size);
+    put16(header, name.length());
+    put16(header, 0); // extra field length
+    header.append(name);
+    if (file.write(header) != header.length()
+            || file.write(item->data) != item->data.length()) {
+        errstr = "Could not write " + item->name + ".";
+        return false;
+    }
+    put32(centralDirectory, centralHeaderSignature);
+    put16(centralDirectory, 20); // version made by
+    put16(centralDirectory, 20); // version needed to extract
+    put16(centralDirectory, flags);
+    put16(centralDirectory, method);
+    put16(centralDirectory, dosTime(item->date));
+    put16(centralDirectory, dosDate(item->date));
+    put32(centralDirectory, item->crc);
+    put32(centralDirectory, item->data.length());
+    put32(centralDirectory, item->size);
+    put16(centralDirectory, name.length());
+    put16(centralDirectory, 0); // extra field length
+    put16(centralDirectory, 0); // comment length
+    put16(centralDirectory, 0); // disk number
+    put16(centralDirectory, 0); // internal attributes
+    put32(centralDirectory, 0); // external attributes
+    put32(centralDirectory, offset);
+    centralDirectory.append(name);
+    // the data is on disk now, so free it early
+    item->data = QByteArray();
+    return true;
+}
+bool
+ZipWriter::finish() {
+    if (!errstr.isNull()) {
+        return false;
+    }
+    if (items.length() > maxEntries) {
+        errstr = "Cannot write " + QString::number(items.length())
+                + " entries: zip files with more than "
+                + QString::number(maxEntries) + " are not supported.";
+        return false;
+    }
+    QByteArray centralDirectory;
+    foreach (Item* item, items) {
+        if (!writeItem(item, centralDirectory)) {
+            return false;
+        }
+    }
+    if (file.pos() + centralDirectory.length() > maxOffset) {
+        errstr = "Cannot write " + file.fileName()
+                + ": zip files over 4 GB are not supported.";
+        return false;
+    }
+    const quint32 offset = file.pos();
+    QByteArray end;
+    put32(end, endOfCentralDirectorySignature);
+    put16(end, 0); // number of this disk
+    put16(end, 0); // disk with the central directory
+    put16(end, items.length());
+    put16(end, items.length());
+    put32(end, centralDirectory.length());
+    put32(end, offset);
+    put16(end, 0); // comment length
+    centralDirectory.append(end);
+    if (file.write(centralDirectory) != centralDirectory.length()
+            || !file.commit()) {
+        errstr = "Could not write " + file.fileName() + ".";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef ZIPWRITER_H
+#define ZIPWRITER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QSaveFile>
+#include <QString>
+#include <QThreadPool>
+
+// writes a zip file; entries are compressed in parallel on a thread pool and
+// written in the order in which they were added
+class ZipWriter {
+public:
+    struct Item;
+private:
+    QSaveFile file;
+    const int level;
+    QThreadPool pool;
+    QList<Item*> items;
+    QString errstr;
+    void queue(Item* item);
+    bool writeItem(Item* item, QByteArray& centralDirectory);
+public:
+    /**
+     * Start writing a zip file to path. The file only replaces path when
+     * finish() succeeds. level is a zlib compression level.
+     */
+    ZipWriter(const QString& path, int level);
+    ~ZipWriter();
+    /**
+     * Queue an entry. Compression starts right away. An entry named
+     * 'mimetype' is always written first and uncompressed, as ODF requires.
+     */
+    void add(const QString& name, const QByteArray& data, bool compress,
+             const QDateTime& date);
+    /**
+     * Queue an entry whose data is already compressed with the given zip
+     * method, e.g. copied unchanged from another package.
+     */
+    void addRaw(const QString& name, const QByteArray& data, quint16 method,
+                quint32 crc, qint64 size, const QDateTime& date);
+    /**
+     * Wait for all entries and write them, followed by the central directory.
+     * Fails for packages that would need ZIP64: more than 65535 entries or
+     * more than 4 GB.
+     */
+    bool finish();
+    QString error() const {
+        return errstr;
+    }
+};
+
+#endif
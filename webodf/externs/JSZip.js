@@ -39,6 +39,9 @@ ZipObject.prototype.asUint8Array = function() { "use strict"; };
 /**@type{!Date}*/
 ZipObject.prototype.date;
 
+/**@type{!Object}*/
+ZipObject.prototype.options;
+
 /**
  * @constructor
  */
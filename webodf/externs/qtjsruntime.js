@@ -0,0 +1,154 @@
+/**
+ * Copyright (C) 2014 KO GmbH <copyright@kogmbh.com>
+ *
+ * @licstart
+ * This file is part of WebODF.
+ *
+ * WebODF is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License (GNU AGPL)
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * WebODF is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with WebODF.  If not, see <http://www.gnu.org/licenses/>.
+ * @licend
+ *
+ * @source: http://www.webodf.org/
+ * @source: https://github.com/kogmbh/WebODF/
+ */
+
+/*jslint emptyblock: true, unparam: true */
+
+/**
+ * Objects that the qtjsruntime adds to the window.
+ */
+
+/**
+ * Byte array as passed from C++. It is a Uint8ClampedArray.
+ * @typedef {!{buffer:!ArrayBuffer,byteOffset:!number,length:!number}}
+ */
+var QtByteArray;
+
+/**
+ * @constructor
+ */
+function QtNativeZip() { "use strict"; }
+
+/**
+ * @return {!string}
+ */
+QtNativeZip.prototype.error = function () { "use strict"; };
+
+/**
+ * @param {!string} path
+ * @return {!number}
+ */
+QtNativeZip.prototype.open = function (path) { "use strict"; };
+
+/**
+ * @param {!number} id
+ * @return {undefined}
+ */
+QtNativeZip.prototype.close = function (id) { "use strict"; };
+
+/**
+ * @param {!number} id
+ * @return {!Array.<!{filename:!string,date:!Date,compressed:!boolean}>}
+ */
+QtNativeZip.prototype.entries = function (id) { "use strict"; };
+
+/**
+ * @param {!number} id
+ * @param {!string} filename
+ * @return {!QtByteArray}
+ */
+QtNativeZip.prototype.load = function (id, filename) { "use strict"; };
+
+/**
+ * @param {!number} id
+ * @param {!string} filename
+ * @return {!string}
+ */
+QtNativeZip.prototype.loadAsString = function (id, filename) { "use strict"; };
+
+/**
+ * @param {!number} id
+ * @param {!string} filename
+ * @param {!string} mimetype
+ * @return {!string}
+ */
+QtNativeZip.prototype.loadAsDataURL = function (id, filename, mimetype) { "use strict"; };
+
+/**
+ * @param {!number} id
+ * @param {!string} filename
+ * @return {!string}
+ */
+QtNativeZip.prototype.entryURL = function (id, filename) { "use strict"; };
+
+/**
+ * @param {!string} path
+ * @return {!number}
+ */
+QtNativeZip.prototype.beginPackage = function (path) { "use strict"; };
+
+/**
+ * @param {!number} writer
+ * @param {!string} filename
+ * @param {!Uint8ClampedArray} data
+ * @param {!boolean} compressed
+ * @param {!Date} date
+ * @return {undefined}
+ */
+QtNativeZip.prototype.addEntry = function (writer, filename, data, compressed, date) { "use strict"; };
+
+/**
+ * @param {!number} writer
+ * @param {!number} id
+ * @param {!string} filename
+ * @return {!boolean}
+ */
+QtNativeZip.prototype.copyEntry = function (writer, id, filename) { "use strict"; };
+
+/**
+ * @param {!number} writer
+ * @return {!boolean}
+ */
+QtNativeZip.prototype.finishPackage = function (writer) { "use strict"; };
+
+/**
+ * @param {!number} writer
+ * @return {undefined}
+ */
+QtNativeZip.prototype.cancelPackage = function (writer) { "use strict"; };
+
+/**
+ * @type {!QtNativeZip}
+ */
+var nativezip;
+
+/**
+ * @constructor
+ */
+function QtNativeIO() { "use strict"; }
+
+/**
+ * @return {!string}
+ */
+QtNativeIO.prototype.error = function () { "use strict"; };
+
+/**
+ * @param {!Uint8ClampedArray} data
+ * @return {!Array.<!string>}
+ */
+QtNativeIO.prototype.registerFont = function (data) { "use strict"; };
+
+/**
+ * @type {!QtNativeIO}
+ */
+var nativeio;
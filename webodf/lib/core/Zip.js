@@ -22,7 +22,7 @@
  * @source: https://github.com/kogmbh/WebODF/
  */
 
-/*global runtime, core, DOMParser, externs*/
+/*global runtime, core, DOMParser, externs, nativezip*/
 /*jslint bitwise: true*/
 
 /**
@@ -39,17 +39,61 @@ core.Zip = function Zip(url, entriesReadCallback) {
         self = this,
         /**@type{!JSZip}*/
         zip,
-        base64 = new core.Base64();
+        base64 = new core.Base64(),
+        /**
+         * Handle of the package in the native zip reader, 0 if the package
+         * was not opened natively.
+         * @type{!number}
+         */
+        nativeZipId = 0,
+        /**
+         * Names of the entries in the native package, in package order.
+         * @type{!Array.<!string>}
+         */
+        nativeOrder = [],
+        /**
+         * Entries of the native package that have not been replaced or
+         * removed yet.
+         * @type{!Object.<!string,!{date:!Date,compressed:!boolean}>}
+         */
+        nativeEntries = {};
 
+    /**
+     * Return the native zip reader of the qtjsruntime if it is available.
+     * @return {?QtNativeZip}
+     */
+    function getNativeZip() {
+        return String(typeof nativezip) !== "undefined" ? nativezip : null;
+    }
+    /**
+     * @param {!string} filename
+     * @return {!boolean}
+     */
+    function isNativeEntry(filename) {
+        return nativeEntries.hasOwnProperty(filename);
+    }
     /**
      * @param {!string} filename
      * @param {!function(?string, ?Uint8Array)} callback receiving err and data
      * @return {undefined}
      */
     function load(filename, callback) {
-        var entry = zip.file(filename);
+        var entry = zip.file(filename),
+            native,
+            data,
+            err;
         if (entry) {
             callback(null, entry.asUint8Array());
+        } else if (isNativeEntry(filename)) {
+            native = /**@type{!QtNativeZip}*/(getNativeZip());
+            data = native.load(nativeZipId, filename);
+            err = native.error();
+            if (err) {
+                callback(err, null);
+            } else {
+                callback(null, new Uint8Array(data.buffer, data.byteOffset,
+                                              data.length));
+            }
         } else {
             callback(filename + " not found.", null);
         }
@@ -60,6 +104,15 @@ core.Zip = function Zip(url, entriesReadCallback) {
      * @return {undefined}
      */
     function loadAsString(filename, callback) {
+        var native, d, err;
+        if (isNativeEntry(filename)) {
+            // let the native reader inflate and decode in one go
+            native = /**@type{!QtNativeZip}*/(getNativeZip());
+            d = native.loadAsString(nativeZipId, filename);
+            err = native.error();
+            callback(err || null, err ? null : d);
+            return;
+        }
         // the javascript implementation simply reads the file and converts to
         // string
         load(filename, function (err, data) {
@@ -90,6 +143,16 @@ core.Zip = function Zip(url, entriesReadCallback) {
      * @param {!function(?string,?string):undefined} callback
      */
     function loadAsDataURL(filename, mimetype, callback) {
+        var native, url, err;
+        if (isNativeEntry(filename)) {
+            // the native reader inflates and encodes without building the
+            // string piecewise in javascript
+            native = /**@type{!QtNativeZip}*/(getNativeZip());
+            url = native.loadAsDataURL(nativeZipId, filename, mimetype || "");
+            err = native.error();
+            callback(err || null, err ? null : url);
+            return;
+        }
         load(filename, function (err, data) {
             if (err || !data) {
                 return callback(err, null);
@@ -121,6 +184,26 @@ core.Zip = function Zip(url, entriesReadCallback) {
             callback(null, dataurl);
         });
     }
+    /**
+     * Pass a url for the entry to the callback. Entries that the qtjsruntime
+     * reads natively get a package url, which the runtime serves from the
+     * zip file when it is loaded, so the data never enters javascript.
+     * Other entries get a data URL.
+     * @param {!string} filename
+     * @param {!string} mimetype
+     * @param {!function(?string,?string):undefined} callback
+     */
+    function loadAsURL(filename, mimetype, callback) {
+        var native, url, err;
+        if (!isNativeEntry(filename)) {
+            loadAsDataURL(filename, mimetype, callback);
+            return;
+        }
+        native = /**@type{!QtNativeZip}*/(getNativeZip());
+        url = native.entryURL(nativeZipId, filename);
+        err = native.error();
+        callback(err || null, err ? null : url);
+    }
     /**
      * @param {!string} filename
      * @param {function(?string,?Document):undefined} callback
@@ -148,6 +231,7 @@ core.Zip = function Zip(url, entriesReadCallback) {
      * @return {undefined}
      */
     function save(filename, data, compressed, date) {
+        delete nativeEntries[filename];
         zip.file(filename, data, {date: date, compression: compressed ? "DEFLATE" : "STORE"});
     }
     /**
@@ -156,10 +240,58 @@ core.Zip = function Zip(url, entriesReadCallback) {
      * @return {!boolean} return false if entry is not found; otherwise true.
      */
     function remove(filename) {
-        var exists = zip.file(filename) !== null;
+        var exists = zip.file(filename) !== null || isNativeEntry(filename);
+        delete nativeEntries[filename];
         zip.remove(filename);
         return exists;
     }
+    /**
+     * Return the names of all entries. Entries from the original package
+     * come first and keep their order.
+     * @return {!Array.<!string>}
+     */
+    function getEntryNames() {
+        var names = nativeOrder.filter(function (filename) {
+            return isNativeEntry(filename) || zip.file(filename) !== null;
+        });
+        Object.keys(zip.files).forEach(function (filename) {
+            if (names.indexOf(filename) === -1) {
+                names.push(filename);
+            }
+        });
+        return names;
+    }
+    /**
+     * Copy the entries that are still only in the native package into the
+     * JSZip object, so that it can generate the complete zip file.
+     * @return {undefined}
+     */
+    function copyNativeEntries() {
+        var /**@type{!JSZip}*/
+            all;
+        if (nativeOrder.length === 0) {
+            return;
+        }
+        all = new externs.JSZip();
+        getEntryNames().forEach(function (filename) {
+            var e = zip.file(filename),
+                n = nativeEntries[filename];
+            if (e) {
+                all.file(filename, e.asUint8Array(), e.options);
+            } else {
+                load(filename, function (err, data) {
+                    if (err || !data) {
+                        throw new Error(err || filename + " cannot be read.");
+                    }
+                    all.file(filename, data, {date: n.date,
+                        compression: n.compressed ? "DEFLATE" : "STORE"});
+                });
+            }
+        });
+        zip = all;
+        nativeEntries = {};
+        nativeOrder = [];
+    }
     /**
      * Create a bytearray from the zipfile.
      * @param {!function(!Uint8Array):undefined} successCallback receiving zip as bytearray
@@ -168,11 +300,63 @@ core.Zip = function Zip(url, entriesReadCallback) {
      */
     function createByteArray(successCallback, errorCallback) {
         try {
+            copyNativeEntries();
             successCallback(/**@type{!Uint8Array}*/(zip.generate({type: "uint8array", compression: "STORE"})));
         } catch(/**@type{!Error}*/e) {
             errorCallback(e.message);
         }
     }
+    /**
+     * Write the zipfile to the given path with the native package writer,
+     * which compresses the entries in parallel.
+     * @param {!QtNativeZip} native
+     * @param {!string} newurl
+     * @param {!function(?string):undefined} callback receiving possible err
+     * @return {undefined}
+     */
+    function writeNative(native, newurl, callback) {
+        var writer = native.beginPackage(newurl),
+            /**@type{?string}*/
+            error = null;
+        /**
+         * @param {!string} filename
+         * @param {!Uint8Array} data
+         * @param {!boolean} compressed
+         * @param {!Date} date
+         * @return {undefined}
+         */
+        function add(filename, data, compressed, date) {
+            native.addEntry(writer, filename, new Uint8ClampedArray(
+                data.buffer,
+                data.byteOffset,
+                data.length
+            ), compressed, date);
+        }
+        if (!writer) {
+            return callback(native.error());
+        }
+        getEntryNames().forEach(function (filename) {
+            var e = zip.file(filename);
+            if (error) {
+                return;
+            }
+            if (e) {
+                add(filename, e.asUint8Array(),
+                    e.options.compression === "DEFLATE", e.date);
+            } else if (!native.copyEntry(writer, nativeZipId, filename)) {
+                // untouched entries are copied compressed as they are
+                error = native.error();
+            }
+        });
+        if (error) {
+            native.cancelPackage(writer);
+            return callback(error);
+        }
+        if (!native.finishPackage(writer)) {
+            return callback(native.error());
+        }
+        callback(null);
+    }
     /**
      * Write the zipfile to the given path.
      * @param {!string} newurl
@@ -180,6 +364,10 @@ core.Zip = function Zip(url, entriesReadCallback) {
      * @return {undefined}
      */
     function writeAs(newurl, callback) {
+        var native = getNativeZip();
+        if (native) {
+            return writeNative(native, newurl, callback);
+        }
         createByteArray(function (data) {
             runtime.writeFile(newurl, data, callback);
         }, callback);
@@ -192,8 +380,21 @@ core.Zip = function Zip(url, entriesReadCallback) {
     function write(callback) {
         writeAs(url, callback);
     }
+    /**
+     * Release the native package. Entries that were not loaded yet cannot
+     * be loaded afterwards.
+     * @return {undefined}
+     */
+    function close() {
+        var native = getNativeZip();
+        if (native && nativeZipId) {
+            native.close(nativeZipId);
+            nativeZipId = 0;
+        }
+    }
     this.load = load;
     this.save = save;
+    this.close = close;
     this.remove = remove;
     this.write = write;
     this.writeAs = writeAs;
@@ -203,25 +404,54 @@ core.Zip = function Zip(url, entriesReadCallback) {
     this.loadAsString = loadAsString;
     this.loadAsDOM = loadAsDOM;
     this.loadAsDataURL = loadAsDataURL;
+    this.loadAsURL = loadAsURL;
 
     /**
      * @return {!Array.<!{filename: !string,date: !Date}>}
      */
     this.getEntries = function () {
-        return Object.keys(zip.files).map(function(filename) {
-            var e = zip.files[filename];
+        return getEntryNames().map(function(filename) {
+            var e = zip.file(filename);
             return {
                 filename: filename,
-                date: e.date
+                date: e ? e.date : nativeEntries[filename].date
             };
         });
     };
 
+    /**
+     * Index the package with the native zip reader. Entries are only
+     * inflated when they are loaded.
+     * @param {!QtNativeZip} native
+     * @return {!boolean} false if the package could not be opened natively
+     */
+    function openNative(native) {
+        nativeZipId = native.open(url);
+        if (!nativeZipId) {
+            return false;
+        }
+        native.entries(nativeZipId).forEach(function (e) {
+            nativeOrder.push(e.filename);
+            nativeEntries[e.filename] = {
+                date: e.date,
+                compressed: e.compressed
+            };
+        });
+        runtime.setTimeout(function () {
+            /**@type{!function(?string, !core.Zip):undefined}*/
+            (entriesReadCallback)(null, self);
+        }, 0);
+        return true;
+    }
+
     zip = new externs.JSZip();
     // if no callback is defined, this is a new file
     if (entriesReadCallback === null) {
         return;
     }
+    if (getNativeZip() && openNative(/**@type{!QtNativeZip}*/(getNativeZip()))) {
+        return;
+    }
     runtime.readFile(url, "binary", function (err, result) {
         if (typeof result === "string") {
             err = "file was read as a string. Should be Uint8Array.";
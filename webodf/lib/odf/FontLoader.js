@@ -22,7 +22,7 @@
  * @source: https://github.com/kogmbh/WebODF/
  */
 
-/*global runtime, odf, core, document, xmldom*/
+/*global runtime, odf, core, document, xmldom, nativeio*/
 /*jslint sub: true*/
 
 
@@ -82,6 +82,55 @@
             runtime.log("Problem inserting rule in CSS: " + runtime.toJson(e) + "\nRule: " + rule);
         }
     }
+    /**
+     * Return the family as a CSS string. A family that is already quoted,
+     * as ODF allows, is unquoted first, so it is not quoted twice.
+     * @param {!string} family
+     * @return {!string}
+     */
+    function quoteFamily(family) {
+        var first = family.charAt(0);
+        if (family.length > 1 && (first === "'" || first === "\"")
+                && family.charAt(family.length - 1) === first) {
+            family = family.slice(1, -1);
+        }
+        return "\"" + family.replace(/\\/g, "\\\\").replace(/"/g, "\\\"")
+            .replace(/\n/g, "\\A ") + "\"";
+    }
+    /**
+     * Register the font with the qtjsruntime and let the family of the
+     * declaration refer to it. The runtime keeps fonts across documents
+     * under a family named after the font's hash, so a font that many
+     * documents embed is only parsed once and no other font can stand in
+     * for it.
+     * @param {!string} name
+     * @param {!{href:string,family:string}} font
+     * @param {!Uint8Array} fontdata
+     * @param {!CSSStyleSheet} stylesheet
+     * @return {!boolean} false if the font could not be registered
+     */
+    function addNativeFontToCSS(name, font, fontdata, stylesheet) {
+        var cssFamily = font.family || name,
+            families,
+            rule;
+        if (String(typeof nativeio) === "undefined" || !nativeio.registerFont) {
+            return false;
+        }
+        families = nativeio.registerFont(new Uint8ClampedArray(fontdata.buffer,
+            fontdata.byteOffset, fontdata.length));
+        if (nativeio.error() || families.length === 0) {
+            return false;
+        }
+        rule = "@font-face { font-family: " + quoteFamily(cssFamily) +
+            "; src: local(" + quoteFamily(families[0]) + "); }";
+        try {
+            stylesheet.insertRule(rule, stylesheet.cssRules.length);
+        } catch (/**@type{!DOMException}*/e) {
+            runtime.log("Problem inserting rule in CSS: " + runtime.toJson(e) + "\nRule: " + rule);
+            return false;
+        }
+        return true;
+    }
     /**
      * @param {!Object.<string,{href:string,family:string}>} embeddedFontDeclarations
      * @param {!odf.OdfContainer} odfContainer
@@ -116,7 +165,8 @@
             } else if (!fontdata) {
                 runtime.log("missing font data for "
                     + embeddedFontDeclarations[name].href);
-            } else {
+            } else if (!addNativeFontToCSS(name,
+                    embeddedFontDeclarations[name], fontdata, stylesheet)) {
                 addFontToCSS(name, embeddedFontDeclarations[name], fontdata,
                     stylesheet);
             }
@@ -455,6 +455,34 @@
         }
     }
 
+    /**
+     * Remove the content of the document that starts further than height
+     * below the top of the page, so it is neither laid out nor are its
+     * images loaded.
+     * @param {!Element} odfbody
+     * @param {!number} height
+     * @return {undefined}
+     */
+    function dropContentBelow(odfbody, height) {
+        var doc = /**@type{!Document}*/(odfbody.ownerDocument),
+            top = doc.documentElement.getBoundingClientRect().top,
+            content = odfbody.firstElementChild,
+            node,
+            next;
+        while (content) {
+            node = content.firstElementChild;
+            while (node && node.getBoundingClientRect().top - top <= height) {
+                node = node.nextElementSibling;
+            }
+            while (node) {
+                next = node.nextSibling;
+                content.removeChild(node);
+                node = next;
+            }
+            content = content.nextElementSibling;
+        }
+    }
+
     /**
      * Make the text:line-break elements behave like html br element.
      * @param {!Element} odffragment
@@ -820,6 +848,7 @@
             annotationsPane = null,
             allowAnnotations = false,
             showAnnotationRemoveButton = false,
+            thumbnailRatio = 0,
             /**@type{gui.AnnotationViewManager}*/
             annotationViewManager = null,
             /**@type{!HTMLStyleElement}*/
@@ -1039,6 +1068,10 @@
             modifyLineBreakElements(odfnode.body);
             expandSpaceElements(odfnode.body);
             expandTabElements(odfnode.body);
+            if (thumbnailRatio > 0) {
+                dropContentBelow(odfnode.body, thumbnailRatio
+                    * doc.documentElement.scrollWidth);
+            }
             loadImages(container, odfnode.body, css);
             loadVideos(container, odfnode.body);
 
@@ -1255,6 +1288,18 @@
             return /**@type{!HTMLElement}*/(sizer);
         };
 
+        /**
+         * Only show the top of documents that are loaded from now on, as
+         * high as ratio times the width of the page, e.g. for a thumbnail.
+         * The rest of the content is removed before it is laid out and
+         * before its images are loaded. 0 shows whole documents again.
+         * @param {!number} ratio
+         * @return {undefined}
+         */
+        this.setThumbnailRatio = function (ratio) {
+            thumbnailRatio = ratio;
+        };
+
         /** Allows / disallows annotations
          * @param {!boolean} allow
          * @param {!boolean} showRemoveButton
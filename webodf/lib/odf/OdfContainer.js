@@ -272,7 +272,7 @@
                 return;
             }
             this.mimetype = mimetype;
-            zip.loadAsDataURL(name, mimetype, function (err, url) {
+            zip.loadAsURL(name, mimetype, function (err, url) {
                 if (err) {
                     runtime.log(err);
                 }
@@ -1354,6 +1354,14 @@
             saveAs(url, callback);
         };
 
+        /**
+         * Release the package the container was loaded from. Parts that
+         * were not loaded yet cannot be loaded afterwards.
+         * @return {undefined}
+         */
+        this.close = function () {
+            zip.close();
+        };
         /**
          * @return {!string}
          */
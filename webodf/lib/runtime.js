@@ -95,6 +95,14 @@ Runtime.prototype.readFile = function (path, encoding, callback) {"use strict";
  * @return {!string|!Uint8Array}
  */
 Runtime.prototype.readFileSync = function (path, encoding) {"use strict"; };
+/**
+ * Read several text files completely, throw an exception if there is a
+ * problem. Runtimes that can read them in one go do so.
+ * @param {!Array.<!string>} paths
+ * @param {!string} encoding text encoding
+ * @return {!Array.<!string>}
+ */
+Runtime.prototype.readFilesSync = function (paths, encoding) {"use strict"; };
 /**
  * @param {!string} path
  * @param {!function(?string,?Document):undefined} callback
@@ -307,6 +315,20 @@ Runtime.fromJson = function (jsonstr) {
     return JSON.parse(jsonstr);
 };
 
+/**
+ * Default implementation of readFilesSync that reads the files one by one.
+ * @this {!Runtime}
+ * @param {!Array.<!string>} paths
+ * @param {!string} encoding
+ * @return {!Array.<!string>}
+ */
+Runtime.readFilesSync = function (paths, encoding) {
+    "use strict";
+    var self = this;
+    return paths.map(function (path) {
+        return /**@type{!string}*/(self.readFileSync(path, encoding));
+    });
+};
 /**
  * @param {!Function} f
  * @return {?string}
@@ -775,6 +797,7 @@ function BrowserRuntime() {
     this.readFile = readFile;
     this.read = read;
     this.readFileSync = readFileSync;
+    this.readFilesSync = Runtime.readFilesSync;
     this.writeFile = writeFile;
     this.deleteFile = deleteFile;
     this.loadXML = loadXML;
@@ -1062,6 +1085,7 @@ function NodeJSRuntime() {
         }
         return s;
     };
+    this.readFilesSync = Runtime.readFilesSync;
     /**
      * @param {!string} msgOrCategory
      * @param {string=} msg
@@ -1374,6 +1398,7 @@ function RhinoRuntime() {
         }
         return s;
     };
+    this.readFilesSync = Runtime.readFilesSync;
     /**
      * @param {!string} msgOrCategory
      * @param {string=} msg
@@ -1652,10 +1677,13 @@ var webodf = {};
     function loadFiles(paths) {
         // this function is not strict, so eval can assign to globals
         var i,
+            contents,
             content;
+        // read all files of the load list at once, so runtimes that can
+        // batch reads need only one round trip
+        contents = runtime.readFilesSync(paths, "utf-8");
         for (i = 0; i < paths.length; i += 1) {
-            content = runtime.readFileSync(paths[i], "utf-8");
-            content = addContent(paths[i], /**@type{string}*/(content));
+            content = addContent(paths[i], contents[i]);
             /*jslint evil: true*/
             eval(content);
             /*jslint evil: false*/
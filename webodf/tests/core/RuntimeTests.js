@@ -175,6 +175,18 @@ core.RuntimeTests = function RuntimeTests(runner) {
         r.shouldBe(t, "t.data.charCodeAt(1)", "57186");
     }
 
+    function testReadFilesSync() {
+        var pre = r.resourcePrefix(),
+            paths = [pre + "utf8.txt", pre + "tests.html"];
+        t.contents = runtime.readFilesSync(paths, "utf-8");
+        t.expected = paths.map(function (path) {
+            return runtime.readFileSync(path, "utf-8");
+        });
+        r.shouldBe(t, "t.contents.length", "2");
+        r.shouldBe(t, "t.contents[0]", "t.expected[0]");
+        r.shouldBe(t, "t.contents[1]", "t.expected[1]");
+    }
+
     function testLoadXML(callback) {
         var pre = r.resourcePrefix();
         runtime.loadXML(pre + "tests.html", function (err, xml) {
@@ -197,7 +209,8 @@ core.RuntimeTests = function RuntimeTests(runner) {
             testUtf8ByteArrayToString_hello_withBOM,
             testUtf8ByteArrayToString_hello_noBOM,
             testUtf8ByteArrayToString_surrogates_withBOM,
-            testUtf8ByteArrayToString_surrogates_noBOM
+            testUtf8ByteArrayToString_surrogates_noBOM,
+            testReadFilesSync
         ]);
     };
     this.asyncTests = function () {
@@ -86,6 +86,45 @@ core.ZipTests = function ZipTests(runner) {
         testHi("core/hi-compressed.zip", callback);
     }
 
+    /**
+     * A url from loadAsURL has to give back the content of the entry.
+     * In qtjsruntime, native entries get a url that WebKit loads from the
+     * package; elsewhere it is a data url.
+     */
+    function testLoadAsURL(path, callback) {
+        path = r.resourcePrefix() + path;
+        t.zip = new core.Zip(path, function (err, zip) {
+            t.err = err;
+            r.shouldBeNull(t, "t.err");
+            zip.loadAsURL("hello", "text/plain", function (err, url) {
+                var xhr;
+                t.err = err;
+                r.shouldBeNull(t, "t.err");
+                t.url = url;
+                r.shouldBeNonNull(t, "t.url");
+                if (url && url.substr(0, 7) === "odfpkg:") {
+                    xhr = new XMLHttpRequest();
+                    xhr.open("GET", url, false);
+                    xhr.send(null);
+                    t.data = xhr.responseText;
+                    r.shouldBe(t, "t.data", "'bonjour\\nbonjour\\n'");
+                } else {
+                    t.scheme = url && url.substr(0, 5);
+                    r.shouldBe(t, "t.scheme", "'data:'");
+                }
+                callback();
+            });
+        });
+    }
+
+    function testLoadAsURLUncompressed(callback) {
+        testLoadAsURL("core/hi-uncompressed.zip", callback);
+    }
+
+    function testLoadAsURLCompressed(callback) {
+        testLoadAsURL("core/hi-compressed.zip", callback);
+    }
+
     function testCreateZip(callback) {
         var filename = r.resourcePrefix() + "writetest.zip",
             zip = new core.Zip(filename, null),
@@ -157,6 +196,8 @@ core.ZipTests = function ZipTests(runner) {
             testNonZipFile,
             testHiUncompressed,
             testHiCompressed,
+            testLoadAsURLUncompressed,
+            testLoadAsURLCompressed,
             testCreateZip
         ]);
     };